@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = src tests
\ No newline at end of file
+SUBDIRS = src tests proxy replay
\ No newline at end of file
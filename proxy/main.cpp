@@ -0,0 +1,91 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QStringList>
+#include <QTextStream>
+#include <QUrl>
+
+#include "oauth_networkpool.h"
+#include "signing_proxy.h"
+
+static int usage()
+{
+	QTextStream(stderr) << "Usage: simpleoauth-proxy --tenants <file.ini> [--port <port>]\n"
+	                       "                         [--max-connections-per-host <n>] [--stats-interval <seconds>]\n";
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QString tenantsFile;
+	quint16 port = 8118;
+	int maxConnectionsPerHost = 6;
+	int statsInterval = 10;
+
+	QStringList arguments = app.arguments();
+	for (int i = 1; i < arguments.count(); ++i) {
+		QString argument = arguments[i];
+		if (i + 1 >= arguments.count()) {
+			return usage();
+		}
+		QString value = arguments[++i];
+
+		if (argument == "--tenants") {
+			tenantsFile = value;
+		} else if (argument == "--port") {
+			port = value.toUShort();
+		} else if (argument == "--max-connections-per-host") {
+			maxConnectionsPerHost = value.toInt();
+		} else if (argument == "--stats-interval") {
+			statsInterval = value.toInt();
+		} else {
+			return usage();
+		}
+	}
+
+	if (tenantsFile.isEmpty()) {
+		return usage();
+	}
+
+	OAuth::SigningProxy proxy;
+	if (!proxy.loadTenants(tenantsFile)) {
+		qCritical("Can't read the tenants from %s", qPrintable(tenantsFile));
+		return 1;
+	}
+	proxy.networkPool()->setMaxConnectionsPerHost(maxConnectionsPerHost);
+	proxy.setStatsInterval(statsInterval);
+
+	// Only local applications are allowed to use the credentials
+	if (!proxy.listen(QHostAddress::LocalHost, port)) {
+		qCritical("Can't listen on port %d: %s", port, qPrintable(proxy.errorString()));
+		return 1;
+	}
+
+	return app.exec();
+}
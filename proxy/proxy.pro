@@ -0,0 +1,25 @@
+QT       += core network
+TARGET = simpleoauth-proxy
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp \
+    signing_proxy.cpp
+
+DEFINES += SIMPLEOAUTH_STATIC_LIB
+
+INCLUDEPATH += ../src
+
+LIBS += -L../lib/ -lsimpleoauth
+win32 {
+	POST_TARGETDEPS += "../lib/simpleoauth.lib"
+} else {
+	POST_TARGETDEPS += "../lib/libsimpleoauth.a"
+}
+
+
+HEADERS += \
+    signing_proxy.h
\ No newline at end of file
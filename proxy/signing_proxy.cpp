@@ -0,0 +1,576 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "signing_proxy.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFileInfo>
+#include <QHostAddress>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QSettings>
+#include <QStringList>
+#include <QTcpSocket>
+
+#include "oauth_networkpool.h"
+#include "oauth_refresher.h"
+
+namespace OAuth {
+
+static const int MaxHeaderSize = 64 * 1024;
+static const int MaxBodySize = 16 * 1024 * 1024;
+
+// Headers that only make sense between the client and the proxy
+static bool isHopByHop(const QByteArray& name)
+{
+	static const char* const headers[] = {
+		"connection", "keep-alive", "proxy-connection", "proxy-authorization", "proxy-authenticate",
+		"te", "trailer", "transfer-encoding", "upgrade", "content-length", "host", "x-oauth-tenant", 0
+	};
+
+	QByteArray lower = name.toLower();
+	for (int i = 0; headers[i]; ++i) {
+		if (lower == headers[i]) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static QByteArray headerValue(const QList<QPair<QByteArray, QByteArray> >& headers, const QByteArray& name)
+{
+	for (int i = 0; i < headers.count(); ++i) {
+		if (qstricmp(headers[i].first.constData(), name.constData()) == 0) {
+			return headers[i].second;
+		}
+	}
+	return QByteArray();
+}
+
+SigningProxy::SigningProxy(QObject* parent)
+	: QTcpServer(parent),
+	  m_networkPool(NetworkPool::sharedPool()),
+	  m_nextRequestId(0),
+	  m_requestCount(0),
+	  m_requestsAtLastUpdate(0),
+	  m_totalSigningTime(0),
+	  m_maxSigningTime(0),
+	  m_requestsPerSecond(0)
+{
+	connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+	connect(m_networkPool.data(), SIGNAL(finished(QNetworkReply*)), SLOT(replyFinished(QNetworkReply*)));
+	connect(&m_statsTimer, SIGNAL(timeout()), SLOT(updateStats()));
+
+	m_statsClock.start();
+	setStatsInterval(10);
+}
+
+/*!
+  Adds a tenant whose requests are signed with \a token. Only the requests to one of the
+  \a upstreams are forwarded: a request matches an upstream when it has the same host and its path
+  starts with the path of the upstream. It is then sent with the scheme and port of the upstream.
+  Returns false, and doesn't add the tenant, if an upstream isn't secure (see isSecure()).
+*/
+bool SigningProxy::addTenant(const QString& tenant, const Token& token, const QList<QUrl>& upstreams)
+{
+	foreach (const QUrl& upstream, upstreams) {
+		if (!upstream.isValid() || !isSecure(upstream)) {
+			return false;
+		}
+	}
+
+	m_tokens.insert(tenant, token);
+	delete m_refreshers.take(tenant);
+	m_upstreams.insert(tenant, upstreams);
+	return true;
+}
+
+/*!
+  Adds an OAuth 2.0 tenant whose bearer token is kept fresh with the token endpoint at \a tokenUrl.
+  Returns false if \a tokenUrl or one of the \a upstreams isn't secure.
+*/
+bool SigningProxy::addTenant(const QString& tenant, const Token& token, const QUrl& tokenUrl, const QList<QUrl>& upstreams)
+{
+	if (!isSecure(tokenUrl) || !addTenant(tenant, token, upstreams)) {
+		return false;
+	}
+
+	m_tokens.remove(tenant);
+	TokenRefresher* refresher = new TokenRefresher(this);
+	refresher->start(token, tokenUrl);
+	m_refreshers.insert(tenant, refresher);
+	return true;
+}
+
+/*!
+  Loads the tenants from an INI file, one group per tenant:
+
+  [my-app]
+  type=access              ; access, request or bearer
+  consumer_key=...
+  consumer_secret=...
+  token=...
+  token_secret=...
+  upstreams=https://api.example.com/1.1, https://upload.example.com
+  refresh_token=...        ; bearer only
+  token_url=https://...    ; bearer only, keeps the token fresh
+  expires_at=...           ; bearer only, ISO 8601. Without it, the token is refreshed at startup
+
+  Returns false if the file can't be read, has no tenant, or if a tenant has no upstream or
+  one that isn't secure.
+*/
+bool SigningProxy::loadTenants(const QString& fileName)
+{
+	// QSettings silently treats a missing file as an empty one
+	if (!QFileInfo(fileName).isReadable()) {
+		return false;
+	}
+
+	QSettings settings(fileName, QSettings::IniFormat);
+	if (settings.status() != QSettings::NoError || settings.childGroups().isEmpty()) {
+		return false;
+	}
+
+	foreach (const QString& tenant, settings.childGroups()) {
+		settings.beginGroup(tenant);
+
+		QString type = settings.value("type", "access").toString();
+		Token token;
+		if (type == "bearer") {
+			token.setType(Token::BearerToken);
+		} else if (type == "request") {
+			token.setType(Token::RequestToken);
+		} else {
+			token.setType(Token::AccessToken);
+		}
+		token.setConsumerKey(settings.value("consumer_key").toString());
+		token.setConsumerSecret(settings.value("consumer_secret").toString());
+		token.setTokenString(settings.value("token").toString());
+		token.setTokenSecret(settings.value("token_secret").toString());
+		token.setRefreshToken(settings.value("refresh_token").toString());
+
+		QList<QUrl> upstreams;
+		foreach (const QString& upstream, settings.value("upstreams").toStringList()) {
+			upstreams << QUrl(upstream.trimmed());
+		}
+		if (upstreams.isEmpty()) {
+			qWarning("Tenant %s has no upstreams", qPrintable(tenant));
+			return false;
+		}
+
+		bool added;
+		QUrl tokenUrl = settings.value("token_url").toUrl();
+		if (type == "bearer" && tokenUrl.isValid()) {
+			QDateTime expiresAt = QDateTime::fromString(settings.value("expires_at").toString(), Qt::ISODate);
+			if (token.tokenString().isEmpty()) {
+				token.setType(Token::InvalidToken); // get a first token right away
+			} else {
+				// Without a known expiration date, serve the token while a fresh one is requested
+				token.setExpirationDate(expiresAt.isValid() ? expiresAt : QDateTime::currentDateTime());
+			}
+			added = addTenant(tenant, token, tokenUrl, upstreams);
+		} else {
+			added = addTenant(tenant, token, upstreams);
+		}
+
+		if (!added) {
+			qWarning("Tenant %s would send its credentials over plain http", qPrintable(tenant));
+			return false;
+		}
+
+		settings.endGroup();
+	}
+
+	return true;
+}
+
+/*!
+  Returns true if credentials can be sent to \a url: https, or plain http to the local machine.
+*/
+bool SigningProxy::isSecure(const QUrl& url)
+{
+	if (url.scheme() == "https") {
+		return true;
+	}
+	QHostAddress address;
+	return url.scheme() == "http"
+	       && (url.host() == "localhost" || (address.setAddress(url.host()) && address.isLoopback()));
+}
+
+QSharedPointer<NetworkPool> SigningProxy::networkPool() const { return m_networkPool; }
+
+/*!
+  Sets how often the requests per second are computed and logged. 0 disables logging.
+*/
+void SigningProxy::setStatsInterval(int seconds)
+{
+	if (seconds > 0) {
+		m_statsTimer.start(seconds * 1000);
+	} else {
+		m_statsTimer.stop();
+	}
+}
+
+quint64 SigningProxy::requestCount()       const { return m_requestCount; }
+double  SigningProxy::requestsPerSecond()  const { return m_requestsPerSecond; }
+
+/*!
+  Returns the average time spent in Token::signRequest, in microseconds.
+*/
+double SigningProxy::averageSigningTime() const
+{
+	return m_requestCount ? double(m_totalSigningTime) / m_requestCount / 1000 : 0;
+}
+
+/*!
+  Returns the longest time spent in Token::signRequest, in microseconds.
+*/
+double SigningProxy::maxSigningTime() const { return double(m_maxSigningTime) / 1000; }
+
+void SigningProxy::onNewConnection()
+{
+	while (hasPendingConnections()) {
+		QTcpSocket* socket = nextPendingConnection();
+		connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), SLOT(onDisconnected()));
+		m_buffers.insert(socket, QByteArray());
+		m_busy.insert(socket, false);
+	}
+}
+
+void SigningProxy::onReadyRead()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+	m_buffers[socket] += socket->readAll();
+	processBuffer(socket);
+}
+
+void SigningProxy::onDisconnected()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+	m_buffers.remove(socket);
+	m_busy.remove(socket);
+	socket->deleteLater();
+}
+
+/*!
+  \internal
+  Handles the buffered requests of \a socket one at a time, so that the responses go back in order.
+*/
+void SigningProxy::processBuffer(QTcpSocket* socket)
+{
+	while (m_buffers.contains(socket) && !m_busy.value(socket)) {
+		ClientRequest request;
+		switch (parseRequest(m_buffers[socket], request)) {
+		case Incomplete:
+			return;
+
+		case Malformed:
+			writeError(socket, 400, "Bad Request", "Malformed request");
+			socket->disconnectFromHost();
+			return;
+
+		case LengthRequired:
+			writeError(socket, 411, "Length Required", "Chunked request bodies are not supported");
+			socket->disconnectFromHost();
+			return;
+
+		case TooLarge:
+			writeError(socket, 413, "Request Entity Too Large", "The request body is too large");
+			socket->disconnectFromHost();
+			return;
+
+		case Complete:
+			handleRequest(socket, request);
+			break;
+		}
+	}
+}
+
+SigningProxy::ParseResult SigningProxy::parseRequest(QByteArray& buffer, ClientRequest& request)
+{
+	int headerEnd = buffer.indexOf("\r\n\r\n");
+	if (headerEnd < 0) {
+		return buffer.size() > MaxHeaderSize ? Malformed : Incomplete;
+	}
+
+	QList<QByteArray> lines = buffer.left(headerEnd).split('\n');
+	QList<QByteArray> requestLine = lines.takeFirst().trimmed().split(' ');
+	if (requestLine.count() != 3 || !requestLine[2].startsWith("HTTP/1.")) {
+		return Malformed;
+	}
+	request.method = requestLine[0].toUpper();
+	request.target = requestLine[1];
+
+	foreach (const QByteArray& line, lines) {
+		int colon = line.indexOf(':');
+		if (colon <= 0) {
+			return Malformed;
+		}
+		request.headers << qMakePair(line.left(colon).trimmed(), line.mid(colon + 1).trimmed());
+	}
+
+	if (headerValue(request.headers, "Transfer-Encoding").toLower().contains("chunked")) {
+		return LengthRequired;
+	}
+
+	int contentLength = 0;
+	QByteArray contentLengthHeader = headerValue(request.headers, "Content-Length");
+	if (!contentLengthHeader.isEmpty()) {
+		bool ok;
+		qint64 length = contentLengthHeader.toLongLong(&ok);
+		if (!ok || length < 0) {
+			return Malformed;
+		}
+		if (length > MaxBodySize) {
+			return TooLarge;
+		}
+		contentLength = int(length);
+	}
+
+	if (buffer.size() < headerEnd + 4 + contentLength) {
+		return Incomplete;
+	}
+
+	request.body = buffer.mid(headerEnd + 4, contentLength);
+	buffer.remove(0, headerEnd + 4 + contentLength);
+	return Complete;
+}
+
+void SigningProxy::handleRequest(QTcpSocket* socket, const ClientRequest& request)
+{
+	if (request.target == "/stats") {
+		QList<QPair<QByteArray, QByteArray> > headers;
+		headers << qMakePair(QByteArray("Content-Type"), QByteArray("application/json"));
+		writeResponse(socket, 200, "OK", headers, statsJson());
+		return;
+	}
+
+	if (request.method == "CONNECT") {
+		writeError(socket, 501, "Not Implemented", "Tunnelled requests can't be signed, send http:// URLs instead, "
+		                                           "the proxy forwards them over https");
+		return;
+	}
+
+	QUrl target = QUrl::fromEncoded(request.target, QUrl::StrictMode);
+	if (!target.isValid() || (target.scheme() != "http" && target.scheme() != "https")) {
+		writeError(socket, 400, "Bad Request", "The request target must be an absolute http:// URL");
+		return;
+	}
+
+	QString tenant = QString::fromUtf8(headerValue(request.headers, "X-OAuth-Tenant"));
+	Token token;
+	if (!tenantToken(tenant, token)) {
+		writeError(socket, 403, "Forbidden", "Missing or unknown X-OAuth-Tenant header");
+		return;
+	}
+
+	QUrl url;
+	if (!upstreamUrl(tenant, target, url)) {
+		writeError(socket, 403, "Forbidden", "The request target is not an upstream of this tenant");
+		return;
+	}
+
+	Token::HttpMethod method;
+	if (request.method == "GET")         method = Token::HttpGet;
+	else if (request.method == "POST")   method = Token::HttpPost;
+	else if (request.method == "PUT")    method = Token::HttpPut;
+	else if (request.method == "DELETE") method = Token::HttpDelete;
+	else if (request.method == "HEAD")   method = Token::HttpHead;
+	else {
+		writeError(socket, 405, "Method Not Allowed", "Unsupported method");
+		return;
+	}
+
+	// Form parameters are part of the OAuth 1.0 signature
+	QMultiMap<QString, QString> parameters;
+	if (headerValue(request.headers, "Content-Type").startsWith("application/x-www-form-urlencoded")) {
+		foreach (QByteArray pair, request.body.split('&')) {
+			if (pair.isEmpty()) {
+				continue;
+			}
+			pair.replace('+', ' ');
+			int equal = pair.indexOf('=');
+			parameters.insert(QUrl::fromPercentEncoding(pair.left(equal)),
+			                  equal < 0 ? QString() : QUrl::fromPercentEncoding(pair.mid(equal + 1)));
+		}
+	}
+
+	QElapsedTimer signingTimer;
+	signingTimer.start();
+	QByteArray authorization = token.signRequest(url, Token::HttpHeader, method, parameters);
+	qint64 signingTime = signingTimer.nsecsElapsed();
+
+	m_requestCount++;
+	m_totalSigningTime += signingTime;
+	m_maxSigningTime = qMax(m_maxSigningTime, signingTime);
+
+	QNetworkRequest upstream(url);
+	for (int i = 0; i < request.headers.count(); ++i) {
+		const QByteArray& name = request.headers[i].first;
+		if (isHopByHop(name)) {
+			continue;
+		}
+		QByteArray value = upstream.rawHeader(name);
+		upstream.setRawHeader(name, value.isEmpty() ? request.headers[i].second : value + ", " + request.headers[i].second);
+	}
+	upstream.setRawHeader("Authorization", authorization);
+
+	int requestId = ++m_nextRequestId;
+	upstream.setOriginatingObject(this);
+	upstream.setAttribute(QNetworkRequest::User, requestId);
+	m_pending.insert(requestId, socket);
+	m_acceptsEncoding.insert(requestId, !headerValue(request.headers, "Accept-Encoding").isEmpty());
+	m_busy[socket] = true;
+
+	m_networkPool->send(upstream, request.method, request.body);
+}
+
+void SigningProxy::replyFinished(QNetworkReply* reply)
+{
+	if (reply->request().originatingObject() != this) {
+		return;
+	}
+	reply->deleteLater();
+
+	int requestId = reply->request().attribute(QNetworkRequest::User).toInt();
+	QPointer<QTcpSocket> socket = m_pending.take(requestId);
+	bool acceptsEncoding = m_acceptsEncoding.take(requestId);
+	if (!socket) {
+		return; // the client went away
+	}
+
+	QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+	if (!statusCode.isValid()) {
+		writeError(socket, 502, "Bad Gateway", reply->errorString().toUtf8());
+	} else {
+		QList<QPair<QByteArray, QByteArray> > headers;
+		foreach (const QNetworkReply::RawHeaderPair& header, reply->rawHeaderPairs()) {
+			// QNetworkAccessManager decompresses the body itself when the client didn't ask for an encoding
+			if (isHopByHop(header.first) || (!acceptsEncoding && qstricmp(header.first.constData(), "Content-Encoding") == 0)) {
+				continue;
+			}
+			headers << header;
+		}
+		writeResponse(socket, statusCode.toInt(),
+		              reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toByteArray(),
+		              headers, reply->readAll());
+	}
+
+	// The client may have disconnected while waiting, its socket is already on its way out
+	if (m_buffers.contains(socket)) {
+		m_busy[socket] = false;
+		processBuffer(socket);
+	}
+}
+
+void SigningProxy::updateStats()
+{
+	qint64 elapsed = m_statsClock.restart();
+	if (elapsed > 0) {
+		m_requestsPerSecond = double(m_requestCount - m_requestsAtLastUpdate) * 1000 / elapsed;
+	}
+	m_requestsAtLastUpdate = m_requestCount;
+
+	qDebug("requests/s: %.1f, signing: %.1f us average, %.1f us max (%llu requests)",
+	       m_requestsPerSecond, averageSigningTime(), maxSigningTime(), m_requestCount);
+}
+
+void SigningProxy::writeResponse(QTcpSocket* socket, int statusCode, const QByteArray& reason,
+                                 const QList<QPair<QByteArray, QByteArray> >& headers, const QByteArray& body)
+{
+	QByteArray response = "HTTP/1.1 " + QByteArray::number(statusCode) + " " + reason + "\r\n";
+	for (int i = 0; i < headers.count(); ++i) {
+		response += headers[i].first + ": " + headers[i].second + "\r\n";
+	}
+	response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+	response += body;
+	socket->write(response);
+}
+
+void SigningProxy::writeError(QTcpSocket* socket, int statusCode, const QByteArray& reason, const QByteArray& message)
+{
+	QList<QPair<QByteArray, QByteArray> > headers;
+	headers << qMakePair(QByteArray("Content-Type"), QByteArray("text/plain"));
+	writeResponse(socket, statusCode, reason, headers, message + "\n");
+}
+
+QByteArray SigningProxy::statsJson() const
+{
+	return QString("{\"requests\":%1,\"requests_per_second\":%2,\"signing_us_average\":%3,\"signing_us_max\":%4}")
+	       .arg(m_requestCount).arg(m_requestsPerSecond).arg(averageSigningTime()).arg(maxSigningTime()).toAscii();
+}
+
+bool SigningProxy::tenantToken(const QString& name, Token& token) const
+{
+	if (m_refreshers.contains(name)) {
+		token = m_refreshers.value(name)->token();
+		return token.type() != Token::InvalidToken;
+	}
+	if (m_tokens.contains(name)) {
+		token = m_tokens.value(name);
+		return true;
+	}
+	return false;
+}
+
+/*!
+  \internal
+  Finds the upstream of \a tenant matching \a target, and returns in \a url the URL to send the
+  request to. The scheme and port come from the upstream, whatever the client used.
+  Paths with dot segments are refused: QUrl keeps them, and the server would resolve
+  "/1.1/../admin" outside of the allowed "/1.1".
+*/
+bool SigningProxy::upstreamUrl(const QString& tenant, const QUrl& target, QUrl& url) const
+{
+	// Decoded, so that %2e%2e and %2f are caught too
+	QString decodedPath = QUrl::fromPercentEncoding(target.encodedPath());
+	foreach (const QString& segment, decodedPath.split('/')) {
+		if (segment == "." || segment == "..") {
+			return false;
+		}
+	}
+
+	foreach (const QUrl& upstream, m_upstreams.value(tenant)) {
+		if (target.host().compare(upstream.host(), Qt::CaseInsensitive) != 0
+				|| (upstream.port() != -1 && target.port() != -1 && target.port() != upstream.port())) {
+			continue;
+		}
+
+		QString path = upstream.path();
+		if (!path.isEmpty() && path != "/" && target.path() != path
+				&& !target.path().startsWith(path.endsWith('/') ? path : path + '/')) {
+			continue;
+		}
+
+		url = target;
+		url.setScheme(upstream.scheme());
+		url.setPort(upstream.port());
+		return true;
+	}
+	return false;
+}
+}
@@ -0,0 +1,131 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef SIGNING_PROXY_H
+#define SIGNING_PROXY_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QTcpServer>
+#include <QTimer>
+#include <QUrl>
+
+#include "oauth_token.h"
+
+class QNetworkReply;
+class QTcpSocket;
+
+namespace OAuth {
+
+class NetworkPool;
+class TokenRefresher;
+
+/*!
+  Local HTTP forward proxy signing the requests of several applications with their tenant's Token.
+  Clients send absolute http:// URLs ("GET http://api.example.com/path HTTP/1.1") with an
+  X-OAuth-Tenant header. The proxy only forwards the requests matching one of the upstreams allowed
+  for the tenant, over the scheme and port of that upstream (usually https), so the credentials
+  never leave the machine in clear text.
+*/
+class SigningProxy : public QTcpServer
+{
+	Q_OBJECT
+
+public:
+	explicit SigningProxy(QObject* parent = 0);
+
+	bool addTenant(const QString& tenant, const Token& token, const QList<QUrl>& upstreams);
+	bool addTenant(const QString& tenant, const Token& token, const QUrl& tokenUrl, const QList<QUrl>& upstreams);
+	bool loadTenants(const QString& fileName);
+
+	static bool isSecure(const QUrl& url);
+
+	QSharedPointer<NetworkPool> networkPool() const;
+	void setStatsInterval(int seconds);
+
+	quint64 requestCount() const;
+	double requestsPerSecond() const;
+	double averageSigningTime() const;
+	double maxSigningTime() const;
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+	void onDisconnected();
+	void replyFinished(QNetworkReply* reply);
+	void updateStats();
+
+private:
+	struct ClientRequest {
+		QByteArray method;
+		QByteArray target;
+		QList<QPair<QByteArray, QByteArray> > headers;
+		QByteArray body;
+	};
+
+	enum ParseResult {
+		Incomplete,
+		Complete,
+		Malformed,
+		LengthRequired,
+		TooLarge
+	};
+
+	void processBuffer(QTcpSocket* socket);
+	ParseResult parseRequest(QByteArray& buffer, ClientRequest& request);
+	void handleRequest(QTcpSocket* socket, const ClientRequest& request);
+	void writeResponse(QTcpSocket* socket, int statusCode, const QByteArray& reason,
+	                   const QList<QPair<QByteArray, QByteArray> >& headers, const QByteArray& body);
+	void writeError(QTcpSocket* socket, int statusCode, const QByteArray& reason, const QByteArray& message);
+	QByteArray statsJson() const;
+	bool tenantToken(const QString& tenant, Token& token) const;
+	bool upstreamUrl(const QString& tenant, const QUrl& target, QUrl& url) const;
+
+	QSharedPointer<NetworkPool> m_networkPool;
+	QHash<QString, Token> m_tokens;
+	QHash<QString, TokenRefresher*> m_refreshers;
+	QHash<QString, QList<QUrl> > m_upstreams;
+
+	QHash<QTcpSocket*, QByteArray> m_buffers;
+	QHash<QTcpSocket*, bool> m_busy;
+	QHash<int, QPointer<QTcpSocket> > m_pending;
+	QHash<int, bool> m_acceptsEncoding;
+	int m_nextRequestId;
+
+	QTimer m_statsTimer;
+	QElapsedTimer m_statsClock;
+	quint64 m_requestCount;
+	quint64 m_requestsAtLastUpdate;
+	qint64 m_totalSigningTime; // ns
+	qint64 m_maxSigningTime;   // ns
+	double m_requestsPerSecond;
+};
+}
+
+#endif // SIGNING_PROXY_H
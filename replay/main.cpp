@@ -0,0 +1,116 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QStringList>
+#include <QTextStream>
+
+#include "oauth_recorder.h"
+
+static int usage()
+{
+	QTextStream(stderr) << "Usage: simpleoauth-replay <trace file> [--iterations <n>]\n";
+	return 2;
+}
+
+/*!
+  Feeds a trace written by OAuth::SigningRecorder back through Token::signRequest as fast as possible,
+  reports the throughput, and checks that the signatures still match the recorded ones.
+*/
+int main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QStringList arguments = app.arguments();
+	QString traceFile;
+	int iterations = 10;
+
+	for (int i = 1; i < arguments.count(); ++i) {
+		if (arguments[i] == "--iterations" && i + 1 < arguments.count()) {
+			iterations = qMax(1, arguments[++i].toInt());
+		} else if (traceFile.isEmpty()) {
+			traceFile = arguments[i];
+		} else {
+			return usage();
+		}
+	}
+
+	if (traceFile.isEmpty()) {
+		return usage();
+	}
+
+	OAuth::SigningTraceReader reader;
+	if (!reader.open(traceFile)) {
+		qCritical("%s is not a signing trace", qPrintable(traceFile));
+		return 2;
+	}
+
+	QList<OAuth::RecordedRequest> requests;
+	OAuth::RecordedRequest request;
+	while (reader.readNext(request)) {
+		requests << request;
+	}
+	if (!reader.atEnd()) {
+		qWarning("The trace is truncated or corrupted, replaying the first %d requests", requests.count());
+	}
+	if (requests.isEmpty()) {
+		qCritical("The trace is empty");
+		return 2;
+	}
+
+	// Check the signatures once, outside of the timed loop
+	int mismatches = 0;
+	for (int i = 0; i < requests.count(); ++i) {
+		const OAuth::RecordedRequest& r = requests.at(i);
+		QByteArray signature = OAuth::SigningTraceReader::signature(
+			r.token.signRequest(r.url, r.authMethod, r.method, r.parameters, r.nonce, r.timestamp));
+		if (signature != r.signature) {
+			if (mismatches++ < 10) {
+				qWarning("Request %d: signature mismatch for %s\n  recorded: %s\n  replayed: %s", i,
+				         r.url.toEncoded().constData(), r.signature.constData(), signature.constData());
+			}
+		}
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int iteration = 0; iteration < iterations; ++iteration) {
+		for (int i = 0; i < requests.count(); ++i) {
+			const OAuth::RecordedRequest& r = requests.at(i);
+			r.token.signRequest(r.url, r.authMethod, r.method, r.parameters, r.nonce, r.timestamp);
+		}
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+
+	double signatures = double(requests.count()) * iterations;
+	QTextStream(stdout) << requests.count() << " requests x " << iterations << " iterations: "
+	                    << qRound64(signatures * 1e9 / qMax(elapsed, qint64(1))) << " signatures/s, "
+	                    << double(elapsed) / signatures / 1000 << " us per signature, "
+	                    << mismatches << " signature mismatches\n";
+
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,20 @@
+QT       += core network
+TARGET = simpleoauth-replay
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += \
+    main.cpp
+
+DEFINES += SIMPLEOAUTH_STATIC_LIB
+
+INCLUDEPATH += ../src
+
+LIBS += -L../lib/ -lsimpleoauth
+win32 {
+	POST_TARGETDEPS += "../lib/simpleoauth.lib"
+} else {
+	POST_TARGETDEPS += "../lib/libsimpleoauth.a"
+}
\ No newline at end of file
@@ -24,44 +24,195 @@
  */
 
 #include "oauth_helper.h"
+#include "oauth_networkpool.h"
 
+#include <QAtomicInt>
+#include <QDateTime>
 #include <QDesktopServices>
 #include <QNetworkReply>
 #include <QStringList>
+#include <QVariantMap>
 
 namespace OAuth {
 
+/*!
+  \internal
+  Minimal JSON reader, good enough for the flat objects returned by OAuth 2.0 token endpoints.
+  Nested objects and arrays are skipped. Returns false if the document is not a JSON object.
+*/
+class JsonReader
+{
+public:
+	explicit JsonReader(const QByteArray& json) : m_json(json), m_pos(0) {}
+
+	bool readObject(QVariantMap& object)
+	{
+		skipWhitespace();
+		if (!consume('{')) return false;
+		skipWhitespace();
+		if (consume('}')) return true;
+
+		forever {
+			QString key;
+			QVariant value;
+			skipWhitespace();
+			if (!readString(key)) return false;
+			skipWhitespace();
+			if (!consume(':')) return false;
+			skipWhitespace();
+			if (!readValue(value)) return false;
+			object.insert(key, value);
+			skipWhitespace();
+			if (consume('}')) return true;
+			if (!consume(',')) return false;
+		}
+	}
+
+private:
+	bool atEnd() const { return m_pos >= m_json.size(); }
+	char peek() const { return atEnd() ? '\0' : m_json.at(m_pos); }
+	bool consume(char c) { if (peek() != c) return false; ++m_pos; return true; }
+	void skipWhitespace() { while (!atEnd() && QChar(peek()).isSpace()) ++m_pos; }
+
+	bool readValue(QVariant& value)
+	{
+		char c = peek();
+		if (c == '"') {
+			QString string;
+			if (!readString(string)) return false;
+			value = string;
+			return true;
+		}
+		if (c == '{' || c == '[') {
+			return skipNested();
+		}
+		int start = m_pos;
+		while (!atEnd() && !QChar(peek()).isSpace() && peek() != ',' && peek() != '}' && peek() != ']') {
+			++m_pos;
+		}
+		QByteArray literal = m_json.mid(start, m_pos - start);
+		if (literal == "true") value = true;
+		else if (literal == "false") value = false;
+		else if (literal == "null") value = QVariant();
+		else {
+			bool ok;
+			value = literal.toDouble(&ok);
+			return ok;
+		}
+		return true;
+	}
+
+	bool readString(QString& string)
+	{
+		if (!consume('"')) return false;
+		QByteArray utf8;
+		while (!atEnd()) {
+			char c = m_json.at(m_pos++);
+			if (c == '"') {
+				string = QString::fromUtf8(utf8);
+				return true;
+			}
+			if (c != '\\') {
+				utf8 += c;
+				continue;
+			}
+			if (atEnd()) return false;
+			c = m_json.at(m_pos++);
+			switch (c) {
+			case 'b': utf8 += '\b'; break;
+			case 'f': utf8 += '\f'; break;
+			case 'n': utf8 += '\n'; break;
+			case 'r': utf8 += '\r'; break;
+			case 't': utf8 += '\t'; break;
+			case 'u': {
+				bool ok;
+				ushort code = m_json.mid(m_pos, 4).toUShort(&ok, 16);
+				if (!ok) return false;
+				m_pos += 4;
+				utf8 += QString(QChar(code)).toUtf8();
+				break;
+			}
+			default: utf8 += c; break;
+			}
+		}
+		return false;
+	}
+
+	bool skipNested()
+	{
+		int depth = 0;
+		while (!atEnd()) {
+			char c = peek();
+			if (c == '"') {
+				QString ignored;
+				if (!readString(ignored)) return false;
+				continue;
+			}
+			++m_pos;
+			if (c == '{' || c == '[') ++depth;
+			else if ((c == '}' || c == ']') && --depth == 0) return true;
+		}
+		return false;
+	}
+
+	QByteArray m_json;
+	int m_pos;
+};
+
+// Request ids are unique across Helpers, since they share the same scheduler
+static QAtomicInt lastRequestId(0);
+
 Helper::Helper(QObject* parent)
 	: QObject(parent),
 	  m_error(Helper::NoError),
-	  m_networkManager(new QNetworkAccessManager(this)),
-	  m_token()
+	  m_scheduler(RequestScheduler::sharedScheduler()),
+	  m_requests(),
+	  m_grants()
 {
-	connect(m_networkManager, SIGNAL(finished(QNetworkReply*)), SLOT(replyReceived(QNetworkReply*)));
-	connect(m_networkManager, SIGNAL(sslErrors(QNetworkReply*,QList<QSslError>)), SLOT(onSslErrors(QNetworkReply*,QList<QSslError>)));
+	connect(m_scheduler.data(), SIGNAL(finished(QNetworkReply*)), SLOT(replyReceived(QNetworkReply*)));
+	connect(m_scheduler.data(), SIGNAL(sslErrors(QNetworkReply*,QList<QSslError>)), SLOT(onSslErrors(QNetworkReply*,QList<QSslError>)));
 }
 
 /*!
-  Sets your own QNetworkAccessManager instance to use.
-  This is useful if you have proxy settings, for example.
+  Sets your own QNetworkAccessManager instance to use, instead of the one shared by all the Helpers.
+  This is useful if you have proxy settings, for example. The Helper doesn't take ownership of
+  \a networkManager. The Helper then gets its own scheduler, so the rate limits set on the shared
+  one don't apply to it. Requests still pending on the previous manager are dropped.
 */
 void Helper::setOwnNetworkManager(QNetworkAccessManager* networkManager)
 {
-	m_networkManager = networkManager;
+	m_scheduler->cancel(this);
+	m_scheduler->disconnect(this);
+	m_requests.clear();
+	m_grants.clear();
+
+	m_scheduler = QSharedPointer<RequestScheduler>(new RequestScheduler(), &QObject::deleteLater);
+	m_scheduler->setNetworkPool(QSharedPointer<NetworkPool>(new NetworkPool(networkManager), &QObject::deleteLater));
+	connect(m_scheduler.data(), SIGNAL(finished(QNetworkReply*)), SLOT(replyReceived(QNetworkReply*)));
+	connect(m_scheduler.data(), SIGNAL(sslErrors(QNetworkReply*,QList<QSslError>)), SLOT(onSslErrors(QNetworkReply*,QList<QSslError>)));
 }
 
+/*!
+  Returns the pool this Helper sends its requests through, to tune its connection limits for example.
+*/
+QSharedPointer<NetworkPool> Helper::networkPool() const { return m_scheduler->networkPool(); }
+
+/*!
+  Returns the scheduler this Helper queues its requests into, to set rate limits and
+  to monitor the queue depth and wait time. Unless setOwnNetworkManager() was called, it is
+  shared by all the Helpers of the thread.
+*/
+RequestScheduler* Helper::scheduler() const { return m_scheduler.data(); }
+
 /*!
   Requires: valid consumerKey, consumerSecret and CallBackUrl
 */
-void Helper::getRequestToken(Token temporaryToken, QUrl requestUrl)
+void Helper::getRequestToken(Token temporaryToken, QUrl requestUrl, RequestScheduler::Priority priority)
 {
-	m_token = temporaryToken;
-	m_token.setType(Token::InvalidToken);
+	temporaryToken.setType(Token::InvalidToken);
 
-	QNetworkRequest request;
-	request.setUrl(requestUrl);
-	request.setRawHeader("Authorization", m_token.signRequest(request.url()));
-	m_networkManager->get(request);
+	QNetworkRequest request = prepareRequest(requestUrl, m_requests, temporaryToken);
+	m_scheduler->getSigned(request, temporaryToken, priority);
 }
 
 /*!
@@ -76,19 +227,74 @@ void Helper::getUserAuthorization(Token requestToken, QUrl authorizationUrl)
 /*!
   Requires: tokenType == Token::RequestToken, and valid oauth_token and verifier
 */
-void Helper::getAccessToken(Token requestToken, QUrl url)
+void Helper::getAccessToken(Token requestToken, QUrl url, RequestScheduler::Priority priority)
 {
-	m_token = requestToken;
-	m_token.setType(Token::RequestToken);
+	requestToken.setType(Token::RequestToken);
+
+	QNetworkRequest request = prepareRequest(url, m_requests, requestToken);
+	m_scheduler->getSigned(request, requestToken, priority);
+}
+
+/*!
+  Exchanges the refresh token of an OAuth 2.0 token for a new bearer token (refresh_token grant).
+  Requires: valid consumerKey (client_id), consumerSecret (client_secret) and refreshToken
+*/
+void Helper::refreshAccessToken(Token bearerToken, QUrl tokenUrl, RequestScheduler::Priority priority)
+{
+	QByteArray body = "grant_type=refresh_token&refresh_token=";
+	body += QUrl::toPercentEncoding(bearerToken.refreshToken());
+	postGrant(bearerToken, tokenUrl, body, priority);
+}
+
+/*!
+  Gets a bearer token for the client itself (client_credentials grant).
+  Requires: valid consumerKey (client_id) and consumerSecret (client_secret)
+*/
+void Helper::getClientCredentialsToken(Token clientToken, QUrl tokenUrl, QString scope, RequestScheduler::Priority priority)
+{
+	QByteArray body = "grant_type=client_credentials";
+	if (!scope.isEmpty()) {
+		body += "&scope=" + QUrl::toPercentEncoding(scope);
+	}
+	postGrant(clientToken, tokenUrl, body, priority);
+}
+
+/*!
+  \internal
+  Remembers \a token until the answer to the request arrives, under an id stored in the request.
+  Several requests can then be pending at the same time, and each Helper recognizes its own replies
+  among the ones of the shared scheduler.
+*/
+QNetworkRequest Helper::prepareRequest(const QUrl& url, QHash<int, Token>& pending, const Token& token)
+{
+	int requestId = lastRequestId.fetchAndAddRelaxed(1) + 1;
+	pending.insert(requestId, token);
 
 	QNetworkRequest request;
 	request.setUrl(url);
-	request.setRawHeader("Authorization", m_token.signRequest(request.url()));
-	m_networkManager->get(request);
+	request.setOriginatingObject(this);
+	request.setAttribute(QNetworkRequest::User, requestId);
+	return request;
+}
+
+void Helper::postGrant(const Token& token, const QUrl& tokenUrl, QByteArray body, RequestScheduler::Priority priority)
+{
+	body += "&client_id=" + QUrl::toPercentEncoding(token.consumerKey());
+	body += "&client_secret=" + QUrl::toPercentEncoding(token.consumerSecret());
+
+	QNetworkRequest request = prepareRequest(tokenUrl, m_grants, token);
+	request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+	request.setRawHeader("Accept", "application/json");
+	m_scheduler->post(request, body, priority);
 }
 
 void Helper::replyReceived(QNetworkReply* reply)
 {
+	int requestId = reply->request().attribute(QNetworkRequest::User).toInt();
+	if (!m_requests.contains(requestId) && !m_grants.contains(requestId)) {
+		return;
+	}
+
 	switch (reply->error()) {
 	case QNetworkReply::NoError:
 		m_error = Helper::NoError;
@@ -108,6 +314,19 @@ void Helper::replyReceived(QNetworkReply* reply)
 		break;
 	}
 
+	// Still rate-limited after the scheduler's retries
+	int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	if (status == 429 || (status == 503 && reply->hasRawHeader("Retry-After"))) {
+		m_error = Helper::RateLimited;
+	}
+
+	if (m_grants.contains(requestId)) {
+		grantReplyReceived(reply, m_grants.take(requestId));
+		return;
+	}
+
+	Token token = m_requests.take(requestId);
+
 	QByteArray replyString = reply->readAll();
 
 	QMap<QString, QString> response;
@@ -124,34 +343,77 @@ void Helper::replyReceived(QNetworkReply* reply)
 		m_error = Helper::RequestUnauthorized;
 	}
 
-	m_token.setTokenString(response["oauth_token"]);
-	m_token.setTokenSecret(response["oauth_token_secret"]);
+	token.setTokenString(response["oauth_token"]);
+	token.setTokenSecret(response["oauth_token_secret"]);
 
-	switch (m_token.type()) {
+	switch (token.type()) {
 	case Token::InvalidToken:
 		if (m_error == Helper::NoError) {
-			m_token.setType(Token::RequestToken);
+			token.setType(Token::RequestToken);
 		}
-		emit requestTokenReceived(m_token);
+		emit requestTokenReceived(token);
 		break;
 
 	case Token::RequestToken:
 		if (m_error == Helper::NoError) {
-			m_token.setType(Token::AccessToken);
+			token.setType(Token::AccessToken);
 		}
-		emit accessTokenReceived(m_token);
+		emit accessTokenReceived(token);
 		break;
 	case Token::AccessToken: //To avoid warning on Mac OSX
+	case Token::BearerToken:
 		break;
 	}
 
 	reply->deleteLater();
 }
 
+/*!
+  \internal
+  Parses the JSON response of an OAuth 2.0 token endpoint.
+  \see http://tools.ietf.org/html/rfc6749#section-5.1
+*/
+void Helper::grantReplyReceived(QNetworkReply* reply, Token token)
+{
+	QVariantMap response;
+	if (!JsonReader(reply->readAll()).readObject(response)) {
+		if (m_error == Helper::NoError) {
+			m_error = Helper::NetworkError;
+		}
+	} else if (m_error != Helper::RateLimited
+			&& (response.contains("error")
+			    || response.value("access_token").toString().isEmpty()
+			    || response.value("token_type").toString().compare("bearer", Qt::CaseInsensitive) != 0)) {
+		m_error = Helper::RequestUnauthorized;
+	}
+
+	if (m_error == Helper::NoError) {
+		token.setType(Token::BearerToken);
+		token.setTokenString(response.value("access_token").toString());
+
+		// The server may or may not issue a new refresh token. If not, keep using the previous one
+		if (response.contains("refresh_token")) {
+			token.setRefreshToken(response.value("refresh_token").toString());
+		}
+
+		if (response.contains("expires_in")) {
+			token.setExpirationDate(QDateTime::currentDateTime().addSecs(response.value("expires_in").toInt()));
+		} else {
+			token.setExpirationDate(QDateTime());
+		}
+	}
+
+	emit bearerTokenReceived(token);
+	reply->deleteLater();
+}
+
 void Helper::onSslErrors(QNetworkReply* reply, QList<QSslError> errors)
 {
 	Q_UNUSED(errors);
-	reply->ignoreSslErrors();
+	int requestId = reply->request().attribute(QNetworkRequest::User).toInt();
+	if (m_requests.contains(requestId) || m_grants.contains(requestId)) {
+		reply->ignoreSslErrors();
+	}
 }
 
 Helper::OAuthError Helper::lastError() const { return m_error; }
@@ -26,9 +26,13 @@
 #ifndef OAUTH_HELPER_H
 #define OAUTH_HELPER_H
 
+#include <QHash>
+#include <QNetworkRequest>
 #include <QObject>
+#include <QSharedPointer>
 #include <QSslError>
 
+#include "oauth_scheduler.h"
 #include "oauth_token.h"
 #include "simpleoauth_export.h"
 
@@ -37,6 +41,8 @@ class QNetworkAccessManager;
 
 namespace OAuth {
 
+class NetworkPool;
+
 class SIMPLEOAUTH_EXPORT Helper : public QObject
 {
 	Q_OBJECT
@@ -45,30 +51,46 @@ public:
 	enum OAuthError {
 		NoError,
 		NetworkError,
-		RequestUnauthorized
+		RequestUnauthorized,
+		RateLimited
 	};
 
 	explicit Helper(QObject* parent = 0);
 	void setOwnNetworkManager(QNetworkAccessManager* networkManager);
+	QSharedPointer<NetworkPool> networkPool() const;
+	RequestScheduler* scheduler() const;
 
-	void getRequestToken(Token temporaryToken, QUrl requestUrl);
+	void getRequestToken(Token temporaryToken, QUrl requestUrl,
+	                     RequestScheduler::Priority priority = RequestScheduler::Interactive);
 	void getUserAuthorization(Token requestToken, QUrl authorizationUrl);
-	void getAccessToken(Token requestToken, QUrl url);
+	void getAccessToken(Token requestToken, QUrl url,
+	                    RequestScheduler::Priority priority = RequestScheduler::Interactive);
+
+	void refreshAccessToken(Token bearerToken, QUrl tokenUrl,
+	                        RequestScheduler::Priority priority = RequestScheduler::Interactive);
+	void getClientCredentialsToken(Token clientToken, QUrl tokenUrl, QString scope = QString(),
+	                               RequestScheduler::Priority priority = RequestScheduler::Interactive);
 
 	OAuthError lastError() const;
 
 signals:
 	void requestTokenReceived(OAuth::Token token);
 	void accessTokenReceived(OAuth::Token token);
+	void bearerTokenReceived(OAuth::Token token);
 
 private slots:
 	void replyReceived(QNetworkReply* reply);
 	void onSslErrors(QNetworkReply* reply, QList<QSslError> errors);
 
 private:
+	QNetworkRequest prepareRequest(const QUrl& url, QHash<int, Token>& pending, const Token& token);
+	void postGrant(const Token& token, const QUrl& tokenUrl, QByteArray body, RequestScheduler::Priority priority);
+	void grantReplyReceived(QNetworkReply* reply, Token token);
+
 	Helper::OAuthError m_error;
-	QNetworkAccessManager* m_networkManager;
-	Token m_token;
+	QSharedPointer<RequestScheduler> m_scheduler;
+	QHash<int, Token> m_requests;
+	QHash<int, Token> m_grants;
 };
 }
 #endif // OAUTH_HELPER_H
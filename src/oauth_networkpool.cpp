@@ -0,0 +1,217 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "oauth_networkpool.h"
+#include "oauth_shared_p.h"
+
+#include <QBuffer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+
+namespace OAuth {
+
+static NetworkPool* createSharedPool() { return new NetworkPool(); }
+
+/*!
+  Creates a pool sending its requests through \a networkManager.
+  If \a networkManager is 0, the pool creates and owns its own QNetworkAccessManager.
+  Otherwise the pool doesn't take ownership, and stops sending requests once the manager is deleted.
+*/
+NetworkPool::NetworkPool(QNetworkAccessManager* networkManager, QObject* parent)
+	: QObject(parent),
+	  m_networkManager(networkManager ? networkManager : new QNetworkAccessManager(this)),
+	  m_defaultMaxConnections(6),
+	  m_maxConnections(),
+	  m_activeConnections(),
+	  m_queues(),
+	  m_replies()
+{
+	connect(m_networkManager, SIGNAL(finished(QNetworkReply*)), SLOT(replyFinished(QNetworkReply*)));
+	connect(m_networkManager, SIGNAL(sslErrors(QNetworkReply*,QList<QSslError>)), SLOT(onSslErrors(QNetworkReply*,QList<QSslError>)));
+}
+
+/*!
+  Returns the pool shared by all the Helper instances of the calling thread.
+  QNetworkAccessManager keeps its connections to each host alive between requests, so sharing
+  one manager lets every Helper reuse the warm connections to the token endpoints instead of
+  paying a TCP and TLS handshake each time. Since a QNetworkAccessManager can only be used from
+  the thread it lives in, each thread gets its own pool. The pool is deleted when the last
+  reference goes away.
+*/
+QSharedPointer<NetworkPool> NetworkPool::sharedPool()
+{
+	return threadSharedInstance(&createSharedPool);
+}
+
+QNetworkAccessManager* NetworkPool::networkManager() const { return m_networkManager; }
+
+/*!
+  Sets how many requests may be sent in parallel to the same host. Defaults to 6.
+  Additional requests are queued until a connection becomes available.
+  Note that QNetworkAccessManager itself never opens more than 6 connections per host.
+*/
+void NetworkPool::setMaxConnectionsPerHost(int maxConnections)
+{
+	m_defaultMaxConnections = qMax(1, maxConnections);
+}
+
+/*!
+  Overrides the maximum number of parallel requests for the host of \a url.
+*/
+void NetworkPool::setMaxConnectionsPerHost(const QUrl& url, int maxConnections)
+{
+	m_maxConnections.insert(hostKey(url), qMax(1, maxConnections));
+	dispatch(hostKey(url));
+}
+
+int NetworkPool::maxConnectionsPerHost(const QUrl& url) const
+{
+	return m_maxConnections.value(hostKey(url), m_defaultMaxConnections);
+}
+
+/*!
+  Opens a connection to the host of \a url ahead of time, so that the first request
+  doesn't have to wait for the handshake. Requires Qt 5.2, does nothing otherwise.
+*/
+void NetworkPool::warmUp(const QUrl& url)
+{
+#if QT_VERSION >= 0x050200
+	if (!m_networkManager) {
+		return;
+	}
+	if (url.scheme() == "https") {
+		m_networkManager->connectToHostEncrypted(url.host(), url.port(443));
+	} else {
+		m_networkManager->connectToHost(url.host(), url.port(80));
+	}
+#else
+	Q_UNUSED(url);
+#endif
+}
+
+void NetworkPool::get(const QNetworkRequest& request)
+{
+	send(request, "GET");
+}
+
+void NetworkPool::post(const QNetworkRequest& request, const QByteArray& body)
+{
+	send(request, "POST", body);
+}
+
+/*!
+  Sends \a request with any HTTP method, such as PUT, DELETE or HEAD.
+  Requires Qt 4.7 for methods other than GET and POST.
+*/
+void NetworkPool::send(const QNetworkRequest& request, const QByteArray& verb, const QByteArray& body)
+{
+	PendingRequest pending;
+	pending.request = request;
+	pending.verb = verb;
+	pending.body = body;
+	pending.hasOwner = request.originatingObject() != 0;
+	pending.owner = request.originatingObject();
+
+	QString host = hostKey(request.url());
+	m_queues[host].enqueue(pending);
+	dispatch(host);
+}
+
+void NetworkPool::dispatch(const QString& host)
+{
+	if (!m_networkManager) {
+		return;
+	}
+
+	QQueue<PendingRequest>& queue = m_queues[host];
+	int maxConnections = m_maxConnections.value(host, m_defaultMaxConnections);
+
+	while (!queue.isEmpty() && m_activeConnections.value(host) < maxConnections) {
+		PendingRequest pending = queue.dequeue();
+
+		// Nobody is left to handle the answer
+		if (pending.hasOwner && !pending.owner) {
+			continue;
+		}
+
+		QNetworkReply* reply;
+		if (pending.verb == "GET") {
+			reply = m_networkManager->get(pending.request);
+		} else if (pending.verb == "POST") {
+			reply = m_networkManager->post(pending.request, pending.body);
+		} else if (pending.verb == "PUT") {
+			reply = m_networkManager->put(pending.request, pending.body);
+		} else if (pending.verb == "HEAD") {
+			reply = m_networkManager->head(pending.request);
+		} else if (pending.body.isEmpty()) {
+			reply = m_networkManager->sendCustomRequest(pending.request, pending.verb);
+		} else {
+			QBuffer* body = new QBuffer();
+			body->setData(pending.body);
+			reply = m_networkManager->sendCustomRequest(pending.request, pending.verb, body);
+			body->setParent(reply);
+		}
+		SentRequest sent;
+		sent.host = host;
+		sent.hasOwner = pending.hasOwner;
+		sent.owner = pending.owner;
+		m_replies.insert(reply, sent);
+		m_activeConnections[host]++;
+	}
+
+	if (queue.isEmpty()) {
+		m_queues.remove(host);
+	}
+}
+
+void NetworkPool::replyFinished(QNetworkReply* reply)
+{
+	// The manager may be shared with other code, only handle our own replies
+	if (!m_replies.contains(reply)) {
+		return;
+	}
+
+	SentRequest sent = m_replies.take(reply);
+	if (--m_activeConnections[sent.host] == 0) {
+		m_activeConnections.remove(sent.host);
+	}
+	dispatch(sent.host);
+
+	if (sent.hasOwner && !sent.owner) {
+		// The object that sent the request is gone, nobody will delete the reply
+		reply->deleteLater();
+		return;
+	}
+
+	emit finished(reply);
+}
+
+void NetworkPool::onSslErrors(QNetworkReply* reply, QList<QSslError> errors)
+{
+	if (m_replies.contains(reply)) {
+		emit sslErrors(reply, errors);
+	}
+}
+}
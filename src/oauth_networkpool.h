@@ -0,0 +1,98 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_NETWORKPOOL_H
+#define OAUTH_NETWORKPOOL_H
+
+#include <QHash>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QSslError>
+
+#include "simpleoauth_export.h"
+
+class QNetworkReply;
+class QNetworkAccessManager;
+
+namespace OAuth {
+
+class SIMPLEOAUTH_EXPORT NetworkPool : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit NetworkPool(QNetworkAccessManager* networkManager = 0, QObject* parent = 0);
+
+	static QSharedPointer<NetworkPool> sharedPool();
+
+	QNetworkAccessManager* networkManager() const;
+
+	void setMaxConnectionsPerHost(int maxConnections);
+	void setMaxConnectionsPerHost(const QUrl& url, int maxConnections);
+	int maxConnectionsPerHost(const QUrl& url) const;
+
+	void warmUp(const QUrl& url);
+
+	void get(const QNetworkRequest& request);
+	void post(const QNetworkRequest& request, const QByteArray& body);
+	void send(const QNetworkRequest& request, const QByteArray& verb, const QByteArray& body = QByteArray());
+
+signals:
+	void finished(QNetworkReply* reply);
+	void sslErrors(QNetworkReply* reply, QList<QSslError> errors);
+
+private slots:
+	void replyFinished(QNetworkReply* reply);
+	void onSslErrors(QNetworkReply* reply, QList<QSslError> errors);
+
+private:
+	struct PendingRequest {
+		QNetworkRequest request;
+		QByteArray verb;
+		QByteArray body;
+		bool hasOwner;
+		QPointer<QObject> owner;
+	};
+
+	struct SentRequest {
+		QString host;
+		bool hasOwner;
+		QPointer<QObject> owner;
+	};
+
+	void dispatch(const QString& host);
+
+	QPointer<QNetworkAccessManager> m_networkManager;
+	int m_defaultMaxConnections;
+	QHash<QString, int> m_maxConnections;
+	QHash<QString, int> m_activeConnections;
+	QHash<QString, QQueue<PendingRequest> > m_queues;
+	QHash<QNetworkReply*, SentRequest> m_replies;
+};
+}
+#endif // OAUTH_NETWORKPOOL_H
@@ -0,0 +1,466 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "oauth_recorder.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
+#include <QWaitCondition>
+
+namespace OAuth {
+
+static const quint32 TraceMagic = 0x534F5452; // "SOTR"
+static const quint16 TraceVersion = 2;
+static const int MaxBufferedRequests = 65536; // per signing thread
+static const int FlushThreshold = 1024;
+
+// A trace is a sequence of records. Tokens are written once, and referred to by id afterwards
+enum RecordType {
+	TokenRecord,
+	RequestRecord
+};
+
+/*!
+  \internal
+  Requests recorded by one signing thread, waiting for the recorder thread. Only this thread and
+  the recorder thread take the mutex, and the recorder thread only to take the requests, so
+  signing threads never wait for each other.
+*/
+struct ThreadBuffer
+{
+	ThreadBuffer() : finished(false) {}
+
+	QMutex mutex;
+	QVector<RecordedRequest> requests;
+	bool finished; // the signing thread exited, the buffer can go once drained
+};
+
+/*!
+  \internal
+  Owned by the QThreadStorage of each signing thread, flags its buffer when the thread exits.
+*/
+struct ThreadBufferHandle
+{
+	~ThreadBufferHandle()
+	{
+		QMutexLocker locker(&buffer->mutex);
+		buffer->finished = true;
+	}
+
+	QSharedPointer<ThreadBuffer> buffer;
+};
+
+// Only locked when a thread records its first request, and when the recorder thread drains the buffers
+static QMutex threadBuffersMutex;
+static QList<QSharedPointer<ThreadBuffer> > threadBuffers;
+static QThreadStorage<ThreadBufferHandle*> localBuffers;
+
+static QAtomicInt recording(0);
+static QAtomicInt droppedRequests(0);
+static QMutex wakeMutex;
+static QWaitCondition wakeCondition;
+
+static ThreadBuffer* localBuffer()
+{
+	if (!localBuffers.hasLocalData()) {
+		ThreadBufferHandle* handle = new ThreadBufferHandle();
+		handle->buffer = QSharedPointer<ThreadBuffer>(new ThreadBuffer());
+		localBuffers.setLocalData(handle);
+
+		QMutexLocker locker(&threadBuffersMutex);
+		threadBuffers.append(handle->buffer);
+	}
+	return localBuffers.localData()->buffer.data();
+}
+
+/*!
+  \internal
+  Redacts the buffered requests and writes them to the trace, away from the signing threads.
+*/
+class RecorderThread : public QThread
+{
+public:
+	RecorderThread()
+		: m_stopping(false)
+	{
+	}
+
+	bool open(const QString& fileName)
+	{
+		m_file.setFileName(fileName);
+		if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			return false;
+		}
+
+		m_stream.setDevice(&m_file);
+		m_stream.setVersion(QDataStream::Qt_4_6);
+		m_stream << TraceMagic << TraceVersion;
+
+		// Placeholders are stable within a trace, but can't be matched across traces
+		m_salt = QCryptographicHash::hash(QByteArray::number(QDateTime::currentMSecsSinceEpoch())
+		                                  + QByteArray::number((quintptr)this), QCryptographicHash::Sha1);
+		return true;
+	}
+
+	void finish()
+	{
+		{
+			QMutexLocker locker(&wakeMutex);
+			m_stopping = true;
+		}
+		wakeCondition.wakeOne();
+		wait();
+		m_file.close();
+	}
+
+protected:
+	void run()
+	{
+		forever {
+			bool stopping;
+			{
+				QMutexLocker locker(&wakeMutex);
+				if (!m_stopping) {
+					wakeCondition.wait(&wakeMutex, 500);
+				}
+				stopping = m_stopping;
+			}
+
+			drain();
+			m_file.flush();
+
+			if (stopping) {
+				return;
+			}
+		}
+	}
+
+private:
+	/*!
+	  Writes the requests of every signing thread. The requests of a thread keep their order,
+	  the interleaving between threads is lost.
+	*/
+	void drain()
+	{
+		QList<QSharedPointer<ThreadBuffer> > buffers;
+		{
+			QMutexLocker locker(&threadBuffersMutex);
+			buffers = threadBuffers;
+		}
+
+		foreach (const QSharedPointer<ThreadBuffer>& buffer, buffers) {
+			QVector<RecordedRequest> pending;
+			bool finished;
+			{
+				QMutexLocker locker(&buffer->mutex);
+				pending = buffer->requests;
+				buffer->requests.clear();
+				finished = buffer->finished;
+			}
+
+			foreach (const RecordedRequest& request, pending) {
+				write(request);
+			}
+
+			if (finished) {
+				QMutexLocker locker(&threadBuffersMutex);
+				threadBuffers.removeAll(buffer);
+			}
+		}
+	}
+
+	void write(const RecordedRequest& request)
+	{
+		Token token = request.token;
+		token.setConsumerSecret(placeholder(token.consumerSecret()));
+		token.setTokenSecret(placeholder(token.tokenSecret()));
+		token.setRefreshToken(QString());
+		if (token.type() == Token::BearerToken) {
+			token.setTokenString(placeholder(token.tokenString()));
+		}
+
+		// The reference signature is the one of the redacted request, so that the replay can check it
+		QByteArray authHeader = token.signRequest(request.url, request.authMethod, request.method,
+		                                          request.parameters, request.nonce, request.timestamp);
+
+		quint32 id = tokenId(token); // writes the token first if it's a new one
+		m_stream << quint8(RequestRecord) << id << quint8(request.authMethod) << quint8(request.method)
+		         << request.url.toEncoded() << request.nonce << request.timestamp << quint32(request.parameters.size());
+
+		QMultiMap<QString, QString>::const_iterator p = request.parameters.constBegin();
+		for (; p != request.parameters.constEnd(); ++p) {
+			m_stream << p.key().toUtf8() << p.value().toUtf8();
+		}
+
+		// The signature is enough to check the replay, and much smaller than the whole header
+		m_stream << SigningTraceReader::signature(authHeader);
+	}
+
+	quint32 tokenId(const Token& token)
+	{
+		QByteArray consumerKey = token.consumerKey().toUtf8();
+		QByteArray consumerSecret = token.consumerSecret().toUtf8();
+		QByteArray tokenString = token.tokenString().toUtf8();
+		QByteArray tokenSecret = token.tokenSecret().toUtf8();
+		QByteArray verifier = QUrl::toPercentEncoding(token.verifier());
+		QByteArray callbackUrl = token.callbackUrl().toEncoded();
+
+		QByteArray key = QByteArray::number(token.type()) + '\0' + consumerKey + '\0' + consumerSecret + '\0'
+		               + tokenString + '\0' + tokenSecret + '\0' + verifier + '\0' + callbackUrl;
+
+		if (!m_tokenIds.contains(key)) {
+			quint32 id = m_tokenIds.size();
+			m_tokenIds.insert(key, id);
+			m_stream << quint8(TokenRecord) << id << quint8(token.type()) << consumerKey << consumerSecret
+			         << tokenString << tokenSecret << verifier << callbackUrl;
+		}
+		return m_tokenIds.value(key);
+	}
+
+	// Same length as the secret, so that the signed strings keep their real size
+	QString placeholder(const QString& secret)
+	{
+		if (secret.isEmpty()) {
+			return secret;
+		}
+
+		if (!m_placeholders.contains(secret)) {
+			QByteArray hex;
+			for (int block = 0; hex.size() < secret.size(); ++block) {
+				hex += QCryptographicHash::hash(m_salt + secret.toUtf8() + QByteArray::number(block), QCryptographicHash::Sha1).toHex();
+			}
+			m_placeholders.insert(secret, QString::fromAscii(hex.left(secret.size())));
+		}
+		return m_placeholders.value(secret);
+	}
+
+	bool m_stopping;
+
+	QFile m_file;
+	QDataStream m_stream;
+	QByteArray m_salt;
+	QHash<QString, QString> m_placeholders;
+	QHash<QByteArray, quint32> m_tokenIds;
+};
+
+// Only used by start() and stop(), the signing threads only check the recording flag
+static QMutex recorderMutex;
+static RecorderThread* recorder = 0;
+
+/*!
+  Starts recording every call to Token::signRequest into \a fileName, until stop() is called.
+  The consumer secret, the token secret and bearer tokens are replaced by placeholders of the same
+  length; the url, parameters, nonce and timestamp are recorded as is.
+  Returns false if the file can't be opened.
+*/
+bool SigningRecorder::start(const QString& fileName)
+{
+	stop();
+
+	RecorderThread* thread = new RecorderThread();
+	if (!thread->open(fileName)) {
+		delete thread;
+		return false;
+	}
+
+	// Requests recorded while the previous recording was stopping don't belong to this trace
+	{
+		QMutexLocker locker(&threadBuffersMutex);
+		foreach (const QSharedPointer<ThreadBuffer>& buffer, threadBuffers) {
+			QMutexLocker bufferLocker(&buffer->mutex);
+			buffer->requests.clear();
+		}
+	}
+
+	QMutexLocker locker(&recorderMutex);
+	droppedRequests.fetchAndStoreOrdered(0);
+	recorder = thread;
+	recorder->start(QThread::LowPriority);
+	recording.fetchAndStoreOrdered(1);
+	return true;
+}
+
+/*!
+  Stops recording, and waits until all the recorded requests are written.
+*/
+void SigningRecorder::stop()
+{
+	QMutexLocker locker(&recorderMutex);
+	recording.fetchAndStoreOrdered(0);
+	if (recorder) {
+		recorder->finish();
+		delete recorder;
+		recorder = 0;
+	}
+}
+
+bool SigningRecorder::isRecording() { return recording != 0; }
+
+/*!
+  Returns how many requests were not recorded because the trace couldn't be written fast enough.
+*/
+quint64 SigningRecorder::droppedCount() { return quint64(int(droppedRequests)); }
+
+/*!
+  \internal
+  Called by Token::signRequest. Only copies the inputs into the buffer of the calling thread,
+  all the work happens in the recorder thread.
+*/
+void SigningRecorder::record(const Token& token, const QUrl& url, Token::AuthMethod authMethod, Token::HttpMethod method,
+                             const QMultiMap<QString, QString>& parameters, const QByteArray& nonce, const QByteArray& timestamp)
+{
+	if (!isRecording()) {
+		return;
+	}
+
+	RecordedRequest request;
+	request.token = token;
+	request.url = url;
+	request.authMethod = authMethod;
+	request.method = method;
+	request.parameters = parameters;
+	request.nonce = QByteArray(nonce.constData(), nonce.size()); // may point to a reused buffer
+	request.timestamp = timestamp;
+
+	ThreadBuffer* buffer = localBuffer();
+	int size;
+	{
+		QMutexLocker locker(&buffer->mutex);
+		size = buffer->requests.size();
+		if (size < MaxBufferedRequests) {
+			buffer->requests.append(request);
+		}
+	}
+
+	if (size >= MaxBufferedRequests) {
+		droppedRequests.fetchAndAddRelaxed(1); // the disk can't keep up, don't slow down the signing threads
+	} else if (size + 1 == FlushThreshold) {
+		wakeCondition.wakeOne();
+	}
+}
+
+SigningTraceReader::SigningTraceReader()
+{
+}
+
+/*!
+  Opens a trace written by SigningRecorder. Returns false if the file can't be read or isn't a trace.
+*/
+bool SigningTraceReader::open(const QString& fileName)
+{
+	m_tokens.clear();
+	m_file.close();
+	m_file.setFileName(fileName);
+	if (!m_file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	m_stream.setDevice(&m_file);
+	m_stream.setVersion(QDataStream::Qt_4_6);
+
+	quint32 magic;
+	quint16 version;
+	m_stream >> magic >> version;
+	return m_stream.status() == QDataStream::Ok && magic == TraceMagic && version == TraceVersion;
+}
+
+/*!
+  Reads the next recorded request. Returns false at the end of the trace, or if it is corrupted.
+*/
+bool SigningTraceReader::readNext(RecordedRequest& request)
+{
+	while (!atEnd()) {
+		quint8 type;
+		quint32 id;
+		m_stream >> type >> id;
+
+		if (type == TokenRecord) {
+			quint8 tokenType;
+			QByteArray consumerKey, consumerSecret, tokenString, tokenSecret, verifier, callbackUrl;
+			m_stream >> tokenType >> consumerKey >> consumerSecret >> tokenString >> tokenSecret >> verifier >> callbackUrl;
+
+			Token token;
+			token.setType(Token::TokenType(tokenType));
+			token.setConsumerKey(QString::fromUtf8(consumerKey));
+			token.setConsumerSecret(QString::fromUtf8(consumerSecret));
+			token.setTokenString(QString::fromUtf8(tokenString));
+			token.setTokenSecret(QString::fromUtf8(tokenSecret));
+			token.setVerifier(QString::fromAscii(verifier));
+			token.setCallbackUrl(QUrl::fromEncoded(callbackUrl));
+			m_tokens.insert(id, token);
+			continue;
+		}
+
+		if (type != RequestRecord || !m_tokens.contains(id)) {
+			return false;
+		}
+
+		quint8 authMethod, method;
+		QByteArray url;
+		quint32 parameterCount;
+		m_stream >> authMethod >> method >> url >> request.nonce >> request.timestamp >> parameterCount;
+
+		request.token = m_tokens.value(id);
+		request.authMethod = Token::AuthMethod(authMethod);
+		request.method = Token::HttpMethod(method);
+		request.url = QUrl::fromEncoded(url);
+		request.parameters.clear();
+		for (quint32 i = 0; i < parameterCount && m_stream.status() == QDataStream::Ok; ++i) {
+			QByteArray key, value;
+			m_stream >> key >> value;
+			request.parameters.insert(QString::fromUtf8(key), QString::fromUtf8(value));
+		}
+		m_stream >> request.signature;
+
+		return m_stream.status() == QDataStream::Ok;
+	}
+	return false;
+}
+
+/*!
+  Returns the oauth_signature parameter of \a authHeader, as returned by Token::signRequest.
+  Returns an empty array for bearer tokens, which aren't signed.
+*/
+QByteArray SigningTraceReader::signature(const QByteArray& authHeader)
+{
+	int start = authHeader.indexOf("oauth_signature=\"");
+	if (start < 0) {
+		return QByteArray();
+	}
+	start += 17;
+	return authHeader.mid(start, authHeader.indexOf('"', start) - start);
+}
+
+bool SigningTraceReader::atEnd() const
+{
+	return m_stream.atEnd() || m_stream.status() != QDataStream::Ok;
+}
+}
@@ -0,0 +1,95 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_RECORDER_H
+#define OAUTH_RECORDER_H
+
+#include <QDataStream>
+#include <QFile>
+#include <QHash>
+#include <QMultiMap>
+#include <QUrl>
+
+#include "oauth_token.h"
+#include "simpleoauth_export.h"
+
+namespace OAuth {
+
+/*!
+  One call to Token::signRequest, as read back from a trace file.
+  The secrets of \a token are placeholders, and \a signature is the oauth_signature
+  computed with those placeholders (empty for bearer tokens).
+*/
+struct SIMPLEOAUTH_EXPORT RecordedRequest
+{
+	Token token;
+	QUrl url;
+	Token::AuthMethod authMethod;
+	Token::HttpMethod method;
+	QMultiMap<QString, QString> parameters;
+	QByteArray nonce;
+	QByteArray timestamp;
+	QByteArray signature;
+};
+
+/*!
+  Opt-in recorder of the calls to Token::signRequest, to profile real workloads offline.
+  Signing only copies the (implicitly shared) inputs into a buffer of the calling thread; a background
+  thread redacts them and writes them to a compact binary trace.
+*/
+class SIMPLEOAUTH_EXPORT SigningRecorder
+{
+public:
+	static bool start(const QString& fileName);
+	static void stop();
+	static bool isRecording();
+	static quint64 droppedCount();
+
+	static void record(const Token& token, const QUrl& url, Token::AuthMethod authMethod, Token::HttpMethod method,
+	                   const QMultiMap<QString, QString>& parameters, const QByteArray& nonce, const QByteArray& timestamp);
+
+private:
+	SigningRecorder();
+};
+
+class SIMPLEOAUTH_EXPORT SigningTraceReader
+{
+public:
+	SigningTraceReader();
+
+	bool open(const QString& fileName);
+	bool readNext(RecordedRequest& request);
+	bool atEnd() const;
+
+	static QByteArray signature(const QByteArray& authHeader);
+
+private:
+	QFile m_file;
+	QDataStream m_stream;
+	QHash<quint32, Token> m_tokens;
+};
+}
+
+#endif // OAUTH_RECORDER_H
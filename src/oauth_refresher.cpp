@@ -0,0 +1,174 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "oauth_refresher.h"
+
+#include <QDateTime>
+
+namespace OAuth {
+
+static const int MaxTimerInterval = 24 * 3600; // seconds
+
+TokenRefresher::TokenRefresher(QObject* parent)
+	: QObject(parent),
+	  m_helper(new Helper(this)),
+	  m_timer(),
+	  m_refreshDate(),
+	  m_tokenUrl(),
+	  m_refreshMargin(60),
+	  m_retryInterval(10),
+	  m_refreshing(false),
+	  m_lock(),
+	  m_token()
+{
+	m_timer.setSingleShot(true);
+	connect(&m_timer, SIGNAL(timeout()), SLOT(onTimeout()));
+	connect(m_helper, SIGNAL(bearerTokenReceived(OAuth::Token)), SLOT(bearerTokenReceived(OAuth::Token)));
+}
+
+/*!
+  Sets how many seconds before the token expires it should be renewed. Defaults to 60 seconds.
+  The margin should leave enough time for the token endpoint to answer, so that token() never
+  returns an expired token. It is capped to half the lifetime of the token.
+*/
+void TokenRefresher::setRefreshMargin(int seconds) { m_refreshMargin = seconds; }
+
+/*!
+  Sets how many seconds to wait before trying again after a failed refresh. Defaults to 10 seconds.
+*/
+void TokenRefresher::setRetryInterval(int seconds) { m_retryInterval = seconds; }
+
+int TokenRefresher::refreshMargin() const { return m_refreshMargin; }
+int TokenRefresher::retryInterval() const { return m_retryInterval; }
+
+/*!
+  Starts keeping \a token fresh using the token endpoint at \a tokenUrl.
+  The token is renewed with the refresh_token grant if it has a refresh token,
+  and with the client_credentials grant otherwise.
+  If \a token is not a valid bearer token yet, a new one is requested right away.
+*/
+void TokenRefresher::start(Token token, QUrl tokenUrl)
+{
+	{
+		QWriteLocker locker(&m_lock);
+		m_token = token;
+	}
+	m_tokenUrl = tokenUrl;
+
+	if (token.type() != Token::BearerToken) {
+		refresh();
+	} else if (token.expirationDate().isValid()) {
+		scheduleRefresh(refreshDelay(token.expirationDate()));
+	}
+}
+
+void TokenRefresher::stop()
+{
+	m_timer.stop();
+}
+
+/*!
+  Returns the current token. This method is thread-safe and never waits for the network:
+  renewal happens in the background, and the previous token is returned until it completes.
+*/
+Token TokenRefresher::token() const
+{
+	QReadLocker locker(&m_lock);
+	return m_token;
+}
+
+void TokenRefresher::refresh()
+{
+	if (m_refreshing) {
+		return;
+	}
+	m_refreshing = true;
+
+	Token current = token();
+	if (current.refreshToken().isEmpty()) {
+		m_helper->getClientCredentialsToken(current, m_tokenUrl, QString(), RequestScheduler::Background);
+	} else {
+		m_helper->refreshAccessToken(current, m_tokenUrl, RequestScheduler::Background);
+	}
+}
+
+void TokenRefresher::bearerTokenReceived(OAuth::Token token)
+{
+	m_refreshing = false;
+
+	if (m_helper->lastError() != Helper::NoError) {
+		// Keep serving the current token, it may still be valid for a while
+		scheduleRefresh(m_retryInterval);
+		emit refreshFailed(m_helper->lastError());
+		return;
+	}
+
+	{
+		QWriteLocker locker(&m_lock);
+		m_token = token;
+	}
+
+	if (token.expirationDate().isValid()) {
+		// Never refresh right after a refresh, even if the server hands out very short-lived tokens
+		scheduleRefresh(qMax(1, refreshDelay(token.expirationDate())));
+	}
+
+	emit tokenRefreshed(token);
+}
+
+/*!
+  \internal
+  Returns in how many seconds a token expiring at \a expirationDate should be renewed.
+  The margin is capped to half the remaining lifetime, so that tokens living less than
+  the margin don't get refreshed continuously.
+*/
+int TokenRefresher::refreshDelay(const QDateTime& expirationDate) const
+{
+	int lifetime = QDateTime::currentDateTime().secsTo(expirationDate);
+	return lifetime - qMin(m_refreshMargin, lifetime / 2);
+}
+
+/*!
+  \internal
+  Tokens can live for months, longer than a QTimer interval can hold, so the timer is capped
+  to a day and rearmed until the refresh date is reached.
+*/
+void TokenRefresher::scheduleRefresh(int seconds)
+{
+	seconds = qMax(0, seconds);
+	m_refreshDate = QDateTime::currentDateTime().addSecs(seconds);
+	m_timer.start(qMin(seconds, MaxTimerInterval) * 1000);
+}
+
+void TokenRefresher::onTimeout()
+{
+	int remaining = QDateTime::currentDateTime().secsTo(m_refreshDate);
+	if (remaining > 0) {
+		scheduleRefresh(remaining);
+	} else {
+		refresh();
+	}
+}
+}
@@ -0,0 +1,85 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_REFRESHER_H
+#define OAUTH_REFRESHER_H
+
+#include <QDateTime>
+#include <QObject>
+#include <QReadWriteLock>
+#include <QTimer>
+#include <QUrl>
+
+#include "oauth_helper.h"
+#include "oauth_token.h"
+#include "simpleoauth_export.h"
+
+namespace OAuth {
+
+class SIMPLEOAUTH_EXPORT TokenRefresher : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit TokenRefresher(QObject* parent = 0);
+
+	void setRefreshMargin(int seconds);
+	void setRetryInterval(int seconds);
+	int refreshMargin() const;
+	int retryInterval() const;
+
+	void start(Token token, QUrl tokenUrl);
+	void stop();
+
+	Token token() const;
+
+signals:
+	void tokenRefreshed(OAuth::Token token);
+	void refreshFailed(OAuth::Helper::OAuthError error);
+
+public slots:
+	void refresh();
+
+private slots:
+	void bearerTokenReceived(OAuth::Token token);
+	void onTimeout();
+
+private:
+	int refreshDelay(const QDateTime& expirationDate) const;
+	void scheduleRefresh(int seconds);
+
+	Helper* m_helper;
+	QTimer m_timer;
+	QDateTime m_refreshDate;
+	QUrl m_tokenUrl;
+	int m_refreshMargin;
+	int m_retryInterval;
+	bool m_refreshing;
+
+	mutable QReadWriteLock m_lock;
+	Token m_token;
+};
+}
+#endif // OAUTH_REFRESHER_H
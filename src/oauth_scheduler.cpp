@@ -0,0 +1,413 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "oauth_scheduler.h"
+#include "oauth_networkpool.h"
+#include "oauth_shared_p.h"
+
+#include <QNetworkReply>
+
+namespace OAuth {
+
+static const QNetworkRequest::Attribute JobIdAttribute = QNetworkRequest::Attribute(QNetworkRequest::User + 1);
+static const qint64 MaxBackoff = 60000; // ms
+
+static RequestScheduler* createSharedScheduler()
+{
+	RequestScheduler* scheduler = new RequestScheduler();
+	scheduler->setNetworkPool(NetworkPool::sharedPool());
+	return scheduler;
+}
+
+RequestScheduler::RequestScheduler(QObject* parent)
+	: QObject(parent),
+	  m_networkPool(),
+	  m_inFlight(),
+	  m_hosts(),
+	  m_defaultRateLimit(0),
+	  m_defaultBurst(1),
+	  m_maxInFlight(8),
+	  m_maxRetries(3),
+	  m_nextJobId(0),
+	  m_averageWaitTime(0),
+	  m_clock(),
+	  m_timer()
+{
+	m_clock.start();
+	m_timer.setSingleShot(true);
+	connect(&m_timer, SIGNAL(timeout()), SLOT(processQueues()));
+}
+
+/*!
+  Returns the scheduler shared by all the Helper instances of the calling thread, sending its
+  requests through NetworkPool::sharedPool(). Sharing it makes the rate limits, the in-flight cap
+  and the priorities apply to the requests of every Helper, not to each Helper on its own.
+  The scheduler is deleted when the last reference goes away.
+*/
+QSharedPointer<RequestScheduler> RequestScheduler::sharedScheduler()
+{
+	return threadSharedInstance(&createSharedScheduler);
+}
+
+void RequestScheduler::setNetworkPool(QSharedPointer<NetworkPool> networkPool)
+{
+	if (m_networkPool) {
+		m_networkPool->disconnect(this);
+		m_inFlight.clear();
+	}
+
+	m_networkPool = networkPool;
+	connect(m_networkPool.data(), SIGNAL(finished(QNetworkReply*)), SLOT(replyFinished(QNetworkReply*)));
+	connect(m_networkPool.data(), SIGNAL(sslErrors(QNetworkReply*,QList<QSslError>)), SLOT(onSslErrors(QNetworkReply*,QList<QSslError>)));
+	processQueues();
+}
+
+QSharedPointer<NetworkPool> RequestScheduler::networkPool() const { return m_networkPool; }
+
+/*!
+  Sets the default rate limit applied to every host: at most \a requestsPerSecond on average,
+  with bursts of up to \a burst requests. A rate of 0 (the default) means no limit.
+  Hosts that already received requests keep their current limit.
+*/
+void RequestScheduler::setRateLimit(double requestsPerSecond, int burst)
+{
+	m_defaultRateLimit = qMax(0.0, requestsPerSecond);
+	m_defaultBurst = qMax(1, burst);
+}
+
+/*!
+  Sets the rate limit for the host of \a url, overriding the default one.
+*/
+void RequestScheduler::setRateLimit(const QUrl& url, double requestsPerSecond, int burst)
+{
+	HostState& host = hostState(hostKey(url));
+	host.maxRate = qMax(0.0, requestsPerSecond);
+	host.rate = host.maxRate;
+	host.burst = qMax(1, burst);
+	host.tokens = host.burst;
+	processQueues();
+}
+
+/*!
+  Returns the current rate limit for the host of \a url. It is lower than the configured one
+  while the host is answering with rate-limit responses.
+*/
+double RequestScheduler::rateLimit(const QUrl& url) const
+{
+	QString host = hostKey(url);
+	return m_hosts.contains(host) ? m_hosts.value(host).rate : m_defaultRateLimit;
+}
+
+/*!
+  Sets how many requests may be waiting for an answer at the same time, all hosts included.
+  Defaults to 8. 0 means no limit.
+*/
+void RequestScheduler::setMaxInFlight(int maxInFlight)
+{
+	m_maxInFlight = qMax(0, maxInFlight);
+	processQueues();
+}
+
+/*!
+  Sets how many times a request is sent again when the server answers with a rate-limit response
+  (HTTP 429, or 503 with a Retry-After header). Defaults to 3.
+*/
+void RequestScheduler::setMaxRetries(int maxRetries) { m_maxRetries = qMax(0, maxRetries); }
+
+int RequestScheduler::maxInFlight() const { return m_maxInFlight; }
+int RequestScheduler::maxRetries()  const { return m_maxRetries; }
+
+int RequestScheduler::queueDepth() const { return m_queues[Interactive].size() + m_queues[Background].size(); }
+int RequestScheduler::queueDepth(Priority priority) const { return m_queues[priority].size(); }
+int RequestScheduler::inFlight() const { return m_inFlight.size(); }
+
+/*!
+  Returns the average time, in milliseconds, that requests spent in the queue before being sent.
+*/
+qint64 RequestScheduler::averageWaitTime() const { return m_averageWaitTime; }
+
+/*!
+  Returns how long, in milliseconds, the oldest queued request has been waiting.
+*/
+qint64 RequestScheduler::oldestWaitTime() const
+{
+	qint64 now = m_clock.elapsed();
+	qint64 oldest = 0;
+	for (int priority = Interactive; priority <= Background; ++priority) {
+		foreach (const Job& job, m_queues[priority]) {
+			oldest = qMax(oldest, now - job.queuedAt);
+		}
+	}
+	return oldest;
+}
+
+void RequestScheduler::get(const QNetworkRequest& request, Priority priority)
+{
+	enqueue(request, QByteArray(), false, false, Token(), priority);
+}
+
+/*!
+  Sends a GET request with an Authorization header computed from \a token.
+  The request is signed when it leaves the queue, so that its timestamp and nonce are fresh.
+*/
+void RequestScheduler::getSigned(const QNetworkRequest& request, const Token& token, Priority priority)
+{
+	enqueue(request, QByteArray(), false, true, token, priority);
+}
+
+void RequestScheduler::post(const QNetworkRequest& request, const QByteArray& body, Priority priority)
+{
+	enqueue(request, body, true, false, Token(), priority);
+}
+
+/*!
+  Drops the queued requests whose originating object is \a owner, and deletes the replies to the
+  ones already sent instead of emitting finished() for them.
+  This is done automatically when the originating object is destroyed.
+*/
+void RequestScheduler::cancel(QObject* owner)
+{
+	if (!owner) {
+		return;
+	}
+
+	for (int priority = Interactive; priority <= Background; ++priority) {
+		QList<Job>& queue = m_queues[priority];
+		for (int i = queue.size() - 1; i >= 0; --i) {
+			if (queue.at(i).owner == owner) {
+				queue.removeAt(i);
+			}
+		}
+	}
+
+	QHash<int, Job>::iterator it;
+	for (it = m_inFlight.begin(); it != m_inFlight.end(); ++it) {
+		if (it->owner == owner) {
+			it->owner = 0;
+		}
+	}
+}
+
+/*!
+  \internal
+  Requests are tied to the originating object of the QNetworkRequest, if any. The scheduler replaces
+  it with itself when sending the request, so the owner is kept aside to know when nobody is left
+  to handle the answer.
+*/
+void RequestScheduler::enqueue(const QNetworkRequest& request, const QByteArray& body, bool post, bool sign, const Token& token, Priority priority)
+{
+	Job job;
+	job.request = request;
+	job.body = body;
+	job.post = post;
+	job.sign = sign;
+	job.token = token;
+	job.priority = priority;
+	job.queuedAt = m_clock.elapsed();
+	job.attempts = 0;
+	job.hasOwner = request.originatingObject() != 0;
+	job.owner = request.originatingObject();
+
+	m_queues[priority].append(job);
+	processQueues();
+}
+
+/*!
+  \internal
+  Sends every queued request allowed by the in-flight cap and the rate limits, interactive
+  requests first, and schedules the next run for when a blocked host becomes available again.
+  A rate-limited host doesn't hold back the requests to other hosts.
+*/
+void RequestScheduler::processQueues()
+{
+	if (!m_networkPool) {
+		return;
+	}
+
+	qint64 now = m_clock.elapsed();
+	qint64 nextRun = -1;
+
+	for (int priority = Interactive; priority <= Background; ++priority) {
+		QList<Job>& queue = m_queues[priority];
+		int i = 0;
+		while (i < queue.size() && (m_maxInFlight == 0 || m_inFlight.size() < m_maxInFlight)) {
+			if (isOrphaned(queue.at(i))) {
+				queue.removeAt(i);
+				continue;
+			}
+
+			HostState& host = hostState(hostKey(queue.at(i).request.url()));
+			refill(host, now);
+
+			if (now >= host.blockedUntil && (host.rate <= 0 || host.tokens >= 1)) {
+				if (host.rate > 0) {
+					host.tokens -= 1;
+				}
+				send(queue.takeAt(i), now);
+				continue;
+			}
+
+			qint64 available = host.blockedUntil;
+			if (host.rate > 0 && host.tokens < 1) {
+				available = qMax(available, now + qint64((1 - host.tokens) * 1000 / host.rate) + 1);
+			}
+			nextRun = nextRun < 0 ? available : qMin(nextRun, available);
+			++i;
+		}
+	}
+
+	if (nextRun >= 0) {
+		m_timer.start(int(qMax(qint64(0), nextRun - now)));
+	}
+}
+
+void RequestScheduler::send(Job job, qint64 now)
+{
+	// Exponential moving average, over roughly the last 8 requests
+	qint64 waitTime = now - job.queuedAt;
+	m_averageWaitTime += (waitTime - m_averageWaitTime) / 8;
+
+	int jobId = ++m_nextJobId;
+	job.attempts++;
+	job.request.setOriginatingObject(this);
+	job.request.setAttribute(JobIdAttribute, jobId);
+	if (job.sign) {
+		job.request.setRawHeader("Authorization", job.token.signRequest(job.request.url()));
+	}
+	m_inFlight.insert(jobId, job);
+
+	if (job.post) {
+		m_networkPool->post(job.request, job.body);
+	} else {
+		m_networkPool->get(job.request);
+	}
+}
+
+void RequestScheduler::replyFinished(QNetworkReply* reply)
+{
+	if (reply->request().originatingObject() != this) {
+		return;
+	}
+
+	int jobId = reply->request().attribute(JobIdAttribute).toInt();
+	if (!m_inFlight.contains(jobId)) {
+		reply->deleteLater();
+		return;
+	}
+
+	Job job = m_inFlight.take(jobId);
+	qint64 now = m_clock.elapsed();
+	HostState& host = hostState(hostKey(job.request.url()));
+	qint64 retryAfter = 0;
+
+	if (isRateLimited(reply, retryAfter)) {
+		// Back off: block the host for a while, and halve its rate
+		host.rateLimitedCount++;
+		if (retryAfter <= 0) {
+			retryAfter = qMin(MaxBackoff, qint64(1000) << qMin(host.rateLimitedCount - 1, 6));
+		}
+		host.blockedUntil = qMax(host.blockedUntil, now + retryAfter);
+		if (host.maxRate > 0) {
+			host.rate = qMax(host.maxRate / 16, host.rate / 2);
+			host.tokens = 0;
+		}
+
+		if (job.attempts <= m_maxRetries && !isOrphaned(job)) {
+			// Retries go ahead of the requests of the same priority, and keep their original wait time
+			reply->deleteLater();
+			m_queues[job.priority].prepend(job);
+			processQueues();
+			return;
+		}
+	} else {
+		// Slowly get back to the configured rate
+		host.rateLimitedCount = 0;
+		if (host.maxRate > 0 && host.rate < host.maxRate) {
+			host.rate = qMin(host.maxRate, host.rate + host.maxRate / 10);
+		}
+	}
+
+	processQueues();
+
+	if (isOrphaned(job)) {
+		reply->deleteLater();
+		return;
+	}
+	emit finished(reply);
+}
+
+void RequestScheduler::onSslErrors(QNetworkReply* reply, QList<QSslError> errors)
+{
+	int jobId = reply->request().attribute(JobIdAttribute).toInt();
+	if (reply->request().originatingObject() == this && m_inFlight.contains(jobId) && !isOrphaned(m_inFlight.value(jobId))) {
+		emit sslErrors(reply, errors);
+	}
+}
+
+bool RequestScheduler::isOrphaned(const Job& job)
+{
+	return job.hasOwner && !job.owner;
+}
+
+bool RequestScheduler::isRateLimited(QNetworkReply* reply, qint64& retryAfter) const
+{
+	int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+	bool hasRetryAfter = reply->hasRawHeader("Retry-After");
+
+	if (status != 429 && !(status == 503 && hasRetryAfter)) {
+		return false;
+	}
+
+	// Only the delay-seconds form of Retry-After is supported, dates fall back to exponential backoff
+	bool ok;
+	int seconds = reply->rawHeader("Retry-After").trimmed().toInt(&ok);
+	retryAfter = ok ? qMin(MaxBackoff, qint64(seconds) * 1000) : 0;
+	return true;
+}
+
+RequestScheduler::HostState& RequestScheduler::hostState(const QString& host)
+{
+	if (!m_hosts.contains(host)) {
+		HostState state;
+		state.maxRate = m_defaultRateLimit;
+		state.rate = m_defaultRateLimit;
+		state.burst = m_defaultBurst;
+		state.tokens = m_defaultBurst;
+		state.lastRefill = m_clock.elapsed();
+		state.blockedUntil = 0;
+		state.rateLimitedCount = 0;
+		m_hosts.insert(host, state);
+	}
+	return m_hosts[host];
+}
+
+void RequestScheduler::refill(HostState& host, qint64 now)
+{
+	if (host.rate > 0) {
+		host.tokens = qMin(host.burst, host.tokens + (now - host.lastRefill) * host.rate / 1000);
+	}
+	host.lastRefill = now;
+}
+}
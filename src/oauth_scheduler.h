@@ -0,0 +1,138 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_SCHEDULER_H
+#define OAUTH_SCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QNetworkRequest>
+#include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QSslError>
+#include <QTimer>
+
+#include "oauth_token.h"
+#include "simpleoauth_export.h"
+
+class QNetworkReply;
+
+namespace OAuth {
+
+class NetworkPool;
+
+class SIMPLEOAUTH_EXPORT RequestScheduler : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Priority {
+		Interactive, // a user is waiting for the answer
+		Background   // re-authorisations, refreshes, ...
+	};
+
+	explicit RequestScheduler(QObject* parent = 0);
+
+	static QSharedPointer<RequestScheduler> sharedScheduler();
+
+	void setNetworkPool(QSharedPointer<NetworkPool> networkPool);
+	QSharedPointer<NetworkPool> networkPool() const;
+
+	void setRateLimit(double requestsPerSecond, int burst = 1);
+	void setRateLimit(const QUrl& url, double requestsPerSecond, int burst = 1);
+	double rateLimit(const QUrl& url) const;
+	void setMaxInFlight(int maxInFlight);
+	void setMaxRetries(int maxRetries);
+	int maxInFlight() const;
+	int maxRetries() const;
+
+	int queueDepth() const;
+	int queueDepth(Priority priority) const;
+	int inFlight() const;
+	qint64 averageWaitTime() const;
+	qint64 oldestWaitTime() const;
+
+	void get(const QNetworkRequest& request, Priority priority = Interactive);
+	void getSigned(const QNetworkRequest& request, const Token& token, Priority priority = Interactive);
+	void post(const QNetworkRequest& request, const QByteArray& body, Priority priority = Interactive);
+	void cancel(QObject* owner);
+
+signals:
+	void finished(QNetworkReply* reply);
+	void sslErrors(QNetworkReply* reply, QList<QSslError> errors);
+
+private slots:
+	void processQueues();
+	void replyFinished(QNetworkReply* reply);
+	void onSslErrors(QNetworkReply* reply, QList<QSslError> errors);
+
+private:
+	struct Job {
+		QNetworkRequest request;
+		QByteArray body;
+		bool post;
+		bool sign;
+		Token token;
+		Priority priority;
+		qint64 queuedAt;
+		int attempts;
+		bool hasOwner;
+		QPointer<QObject> owner;
+	};
+
+	struct HostState {
+		double maxRate;      // configured requests per second, 0 means unlimited
+		double rate;         // current rate, lowered when the host answers with rate-limit responses
+		double burst;
+		double tokens;
+		qint64 lastRefill;
+		qint64 blockedUntil;
+		int rateLimitedCount;
+	};
+
+	void enqueue(const QNetworkRequest& request, const QByteArray& body, bool post, bool sign, const Token& token, Priority priority);
+	HostState& hostState(const QString& host);
+	void refill(HostState& host, qint64 now);
+	void send(Job job, qint64 now);
+	static bool isOrphaned(const Job& job);
+	bool isRateLimited(QNetworkReply* reply, qint64& retryAfter) const;
+
+	QSharedPointer<NetworkPool> m_networkPool;
+	QList<Job> m_queues[2];
+	QHash<int, Job> m_inFlight;
+	QHash<QString, HostState> m_hosts;
+	double m_defaultRateLimit;
+	int m_defaultBurst;
+	int m_maxInFlight;
+	int m_maxRetries;
+	int m_nextJobId;
+	qint64 m_averageWaitTime;
+	QElapsedTimer m_clock;
+	QTimer m_timer;
+};
+}
+#endif // OAUTH_SCHEDULER_H
@@ -0,0 +1,75 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_SHARED_P_H
+#define OAUTH_SHARED_P_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QThreadStorage>
+#include <QUrl>
+#include <QWeakPointer>
+
+namespace OAuth {
+
+/*!
+  \internal
+  Returns the key under which the limits of the host of \a url are kept. Default ports are made
+  explicit and the host is lowercased, so that "https://Host" and "https://host:443" share a key.
+*/
+inline QString hostKey(const QUrl& url)
+{
+	int port = url.port(url.scheme() == "https" ? 443 : 80);
+	return QString("%1://%2:%3").arg(url.scheme(), url.host().toLower()).arg(port);
+}
+
+/*!
+  \internal
+  Returns the instance of \a T shared within the calling thread, calling \a create when there is
+  none yet or when every reference to the previous one went away.
+  Shared pools and schedulers emit finished() for the replies of all their users, who pick their
+  own by the originating object or an attribute of the request. The last user may release its
+  reference from a slot connected to that signal, hence deleteLater.
+*/
+template <class T>
+QSharedPointer<T> threadSharedInstance(T* (*create)())
+{
+	static QThreadStorage<QWeakPointer<T>*> sharedInstances;
+
+	if (!sharedInstances.hasLocalData()) {
+		sharedInstances.setLocalData(new QWeakPointer<T>());
+	}
+
+	QWeakPointer<T>* sharedInstance = sharedInstances.localData();
+	QSharedPointer<T> instance = sharedInstance->toStrongRef();
+	if (instance.isNull()) {
+		instance = QSharedPointer<T>(create(), &QObject::deleteLater);
+		*sharedInstance = instance;
+	}
+	return instance;
+}
+}
+#endif // OAUTH_SHARED_P_H
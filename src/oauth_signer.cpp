@@ -0,0 +1,438 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#include "oauth_signer.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace OAuth {
+
+namespace {
+
+/*!
+  \internal
+  Plain SHA-1 implementation, so that the signer does not depend on QCryptographicHash.
+  \see http://tools.ietf.org/html/rfc3174
+*/
+class Sha1
+{
+public:
+	enum { BlockSize = 64, DigestSize = 20 };
+
+	Sha1() : m_blockLength(0), m_totalLength(0)
+	{
+		m_state[0] = 0x67452301;
+		m_state[1] = 0xEFCDAB89;
+		m_state[2] = 0x98BADCFE;
+		m_state[3] = 0x10325476;
+		m_state[4] = 0xC3D2E1F0;
+	}
+
+	void addData(const unsigned char* data, std::size_t length)
+	{
+		m_totalLength += length;
+		while (length > 0) {
+			std::size_t chunk = std::min(length, std::size_t(BlockSize) - m_blockLength);
+			std::memcpy(m_block + m_blockLength, data, chunk);
+			m_blockLength += chunk;
+			data += chunk;
+			length -= chunk;
+			if (m_blockLength == BlockSize) {
+				processBlock();
+				m_blockLength = 0;
+			}
+		}
+	}
+
+	void result(unsigned char* digest)
+	{
+		unsigned long long bitLength = m_totalLength * 8;
+
+		m_block[m_blockLength++] = 0x80;
+		if (m_blockLength > BlockSize - 8) {
+			std::memset(m_block + m_blockLength, 0, BlockSize - m_blockLength);
+			processBlock();
+			m_blockLength = 0;
+		}
+		std::memset(m_block + m_blockLength, 0, BlockSize - 8 - m_blockLength);
+		for (int i = 0; i < 8; ++i) {
+			m_block[BlockSize - 1 - i] = (unsigned char)(bitLength >> (8 * i));
+		}
+		processBlock();
+
+		for (int i = 0; i < 5; ++i) {
+			digest[4 * i]     = (unsigned char)(m_state[i] >> 24);
+			digest[4 * i + 1] = (unsigned char)(m_state[i] >> 16);
+			digest[4 * i + 2] = (unsigned char)(m_state[i] >> 8);
+			digest[4 * i + 3] = (unsigned char)(m_state[i]);
+		}
+	}
+
+private:
+	static unsigned int rotate(unsigned int value, int bits) { return ((value << bits) | (value >> (32 - bits))) & 0xFFFFFFFF; }
+
+	void processBlock()
+	{
+		unsigned int w[80];
+		for (int i = 0; i < 16; ++i) {
+			w[i] = (unsigned int)m_block[4 * i] << 24 | (unsigned int)m_block[4 * i + 1] << 16
+			     | (unsigned int)m_block[4 * i + 2] << 8 | (unsigned int)m_block[4 * i + 3];
+		}
+		for (int i = 16; i < 80; ++i) {
+			w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+		}
+
+		unsigned int a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3], e = m_state[4];
+		for (int i = 0; i < 80; ++i) {
+			unsigned int f, k;
+			if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+			else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+			else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+			else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+
+			unsigned int temp = (rotate(a, 5) + f + e + k + w[i]) & 0xFFFFFFFF;
+			e = d;
+			d = c;
+			c = rotate(b, 30);
+			b = a;
+			a = temp;
+		}
+
+		m_state[0] = (m_state[0] + a) & 0xFFFFFFFF;
+		m_state[1] = (m_state[1] + b) & 0xFFFFFFFF;
+		m_state[2] = (m_state[2] + c) & 0xFFFFFFFF;
+		m_state[3] = (m_state[3] + d) & 0xFFFFFFFF;
+		m_state[4] = (m_state[4] + e) & 0xFFFFFFFF;
+	}
+
+	unsigned int m_state[5];
+	unsigned char m_block[BlockSize];
+	std::size_t m_blockLength;
+	unsigned long long m_totalLength;
+};
+
+inline const unsigned char* bytes(ByteSpan span) { return reinterpret_cast<const unsigned char*>(span.data); }
+
+inline void append(std::string& output, ByteSpan span) { output.append(span.data, span.size); }
+
+inline int hexValue(char c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	return -1;
+}
+
+void percentDecode(ByteSpan input, std::string& output)
+{
+	output.clear();
+	for (std::size_t i = 0; i < input.size; ++i) {
+		if (input.data[i] == '%' && i + 2 < input.size && hexValue(input.data[i + 1]) >= 0 && hexValue(input.data[i + 2]) >= 0) {
+			output += char(hexValue(input.data[i + 1]) * 16 + hexValue(input.data[i + 2]));
+			i += 2;
+		} else {
+			output += input.data[i];
+		}
+	}
+}
+
+// Orders the "key=value" pairs the same way as sorting the joined strings would
+class RangeLessThan
+{
+public:
+	explicit RangeLessThan(const char* pairs) : m_pairs(pairs) {}
+
+	template <typename Range>
+	bool operator()(const Range& left, const Range& right) const
+	{
+		int result = std::memcmp(m_pairs + left.offset, m_pairs + right.offset, std::min(left.size, right.size));
+		return result < 0 || (result == 0 && left.size < right.size);
+	}
+
+private:
+	const char* m_pairs;
+};
+
+void appendHeaderParameter(std::string& header, const char* key, ByteSpan value)
+{
+	header += key;
+	header += "=\"";
+	Signer::percentEncode(value, header);
+	header += "\",";
+}
+
+} // namespace
+
+ByteSpan::ByteSpan(const char* string)
+	: data(string),
+	  size(string ? std::strlen(string) : 0)
+{
+}
+
+SigningRequest::SigningRequest()
+	: tokenKind(Temporary),
+	  method("GET"),
+	  baseUrl(),
+	  query(),
+	  parameters(0),
+	  parameterCount(0),
+	  consumerKey(),
+	  consumerSecret(),
+	  token(),
+	  tokenSecret(),
+	  verifier(),
+	  callbackUrl(),
+	  nonce(),
+	  timestamp(),
+	  saslUrl()
+{
+}
+
+NonceGenerator::NonceGenerator(unsigned long long seed)
+	: m_state(seed ? seed : 0x9E3779B97F4A7C15ULL)
+{
+}
+
+ByteSpan NonceGenerator::next()
+{
+	// xorshift64*, http://vigna.di.unimi.it/ftp/papers/xorshift.pdf
+	m_state ^= m_state >> 12;
+	m_state ^= m_state << 25;
+	m_state ^= m_state >> 27;
+	unsigned long long value = (m_state * 2685821657736338717ULL) >> 33;
+
+	char* end = m_buffer + sizeof(m_buffer);
+	char* begin = end;
+	do {
+		*--begin = char('0' + value % 10);
+		value /= 10;
+	} while (value);
+
+	return ByteSpan(begin, end - begin);
+}
+
+Signer::Signer()
+{
+}
+
+/*!
+  Percent-encodes \a input according to RFC 3986 and appends the result to \a output.
+  Only the unreserved characters (ALPHA, DIGIT, '-', '.', '_', '~') are left as is.
+*/
+void Signer::percentEncode(ByteSpan input, std::string& output)
+{
+	static const char hex[] = "0123456789ABCDEF";
+
+	for (std::size_t i = 0; i < input.size; ++i) {
+		unsigned char c = bytes(input)[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+				|| c == '-' || c == '.' || c == '_' || c == '~') {
+			output += char(c);
+		} else {
+			output += '%';
+			output += hex[c >> 4];
+			output += hex[c & 0x0F];
+		}
+	}
+}
+
+/*!
+  Calculates the HMAC-SHA1 signature of \a message with \a key, and appends it to \a output in base64.
+  \see http://tools.ietf.org/html/rfc2104
+*/
+void Signer::hmacSha1Base64(ByteSpan message, ByteSpan key, std::string& output)
+{
+	unsigned char keyBlock[Sha1::BlockSize];
+	std::memset(keyBlock, 0, sizeof(keyBlock));
+
+	// If key is longer than block size, we need to hash the key
+	if (key.size > Sha1::BlockSize) {
+		Sha1 hash;
+		hash.addData(bytes(key), key.size);
+		hash.result(keyBlock);
+	} else {
+		std::memcpy(keyBlock, key.data, key.size);
+	}
+
+	unsigned char ipad[Sha1::BlockSize];
+	unsigned char opad[Sha1::BlockSize];
+	for (int i = 0; i < Sha1::BlockSize; ++i) {
+		ipad[i] = keyBlock[i] ^ 0x36;
+		opad[i] = keyBlock[i] ^ 0x5c;
+	}
+
+	unsigned char digest[Sha1::DigestSize];
+
+	Sha1 inner;
+	inner.addData(ipad, sizeof(ipad));
+	inner.addData(bytes(message), message.size);
+	inner.result(digest);
+
+	Sha1 outer;
+	outer.addData(opad, sizeof(opad));
+	outer.addData(digest, sizeof(digest));
+	outer.result(digest);
+
+	static const char base64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (int i = 0; i < Sha1::DigestSize; i += 3) {
+		unsigned int triple = (unsigned int)digest[i] << 16;
+		if (i + 1 < Sha1::DigestSize) triple |= (unsigned int)digest[i + 1] << 8;
+		if (i + 2 < Sha1::DigestSize) triple |= digest[i + 2];
+
+		output += base64[(triple >> 18) & 0x3F];
+		output += base64[(triple >> 12) & 0x3F];
+		output += i + 1 < Sha1::DigestSize ? base64[(triple >> 6) & 0x3F] : '=';
+		output += i + 2 < Sha1::DigestSize ? base64[triple & 0x3F] : '=';
+	}
+}
+
+/*!
+  Signs \a request with HMAC-SHA1 and appends the resulting Authorization header
+  (or SASL XOAUTH string) to \a header.
+  \see http://oauth.net/core/1.0a/#signing_process
+*/
+void Signer::sign(const SigningRequest& request, std::string& header)
+{
+	// Step 1. Collect and encode all the parameters: oauth params, url params and additional params
+
+	m_pairs.clear();
+	m_ranges.clear();
+
+	addParameter("oauth_consumer_key", request.consumerKey);
+	addParameter("oauth_signature_method", "HMAC-SHA1");
+	addParameter("oauth_timestamp", request.timestamp);
+	addParameter("oauth_nonce", request.nonce);
+	addParameter("oauth_version", "1.0");
+
+	switch (request.tokenKind) {
+	case SigningRequest::Temporary:
+		addParameter("oauth_callback", request.callbackUrl);
+		break;
+
+	case SigningRequest::Request:
+		addParameter("oauth_token", request.token);
+		addParameter("oauth_verifier", request.verifier);
+		break;
+
+	case SigningRequest::Access:
+		addParameter("oauth_token", request.token);
+		break;
+	}
+
+	addQueryParameters(request.query);
+
+	for (std::size_t i = 0; i < request.parameterCount; ++i) {
+		addParameter(request.parameters[i].key, request.parameters[i].value);
+	}
+
+	std::sort(m_ranges.begin(), m_ranges.end(), RangeLessThan(m_pairs.data()));
+
+	// Step 2. Build the signature base string and the key
+
+	m_scratch.clear();
+	for (std::size_t i = 0; i < m_ranges.size(); ++i) {
+		if (i > 0) {
+			m_scratch += '&';
+		}
+		m_scratch.append(m_pairs, m_ranges[i].offset, m_ranges[i].size);
+	}
+
+	m_baseString.clear();
+	append(m_baseString, request.method);
+	m_baseString += '&';
+	percentEncode(request.baseUrl, m_baseString);
+	m_baseString += '&';
+	percentEncode(m_scratch, m_baseString);
+
+	m_key.clear();
+	percentEncode(request.consumerSecret, m_key);
+	m_key += '&';
+	percentEncode(request.tokenSecret, m_key);
+
+	m_signature.clear();
+	hmacSha1Base64(m_baseString, m_key, m_signature);
+
+	// Step 3. Write the oauth params, sorted by name, into the header
+
+	if (!request.saslUrl.isEmpty()) {
+		header += "GET ";
+		append(header, request.saslUrl);
+		header += ' ';
+	} else {
+		header += "OAuth ";
+	}
+
+	if (request.tokenKind == SigningRequest::Temporary) {
+		appendHeaderParameter(header, "oauth_callback", request.callbackUrl);
+	}
+	appendHeaderParameter(header, "oauth_consumer_key", request.consumerKey);
+	appendHeaderParameter(header, "oauth_nonce", request.nonce);
+	appendHeaderParameter(header, "oauth_signature", m_signature);
+	appendHeaderParameter(header, "oauth_signature_method", "HMAC-SHA1");
+	appendHeaderParameter(header, "oauth_timestamp", request.timestamp);
+	if (request.tokenKind != SigningRequest::Temporary) {
+		appendHeaderParameter(header, "oauth_token", request.token);
+	}
+	if (request.tokenKind == SigningRequest::Request) {
+		appendHeaderParameter(header, "oauth_verifier", request.verifier);
+	}
+	appendHeaderParameter(header, "oauth_version", "1.0");
+
+	header.resize(header.size() - 1); // remove the trailing ","
+}
+
+void Signer::addParameter(ByteSpan key, ByteSpan value)
+{
+	Range range;
+	range.offset = m_pairs.size();
+	percentEncode(key, m_pairs);
+	m_pairs += '=';
+	percentEncode(value, m_pairs);
+	range.size = m_pairs.size() - range.offset;
+	m_ranges.push_back(range);
+}
+
+/*!
+  \internal
+  Splits a percent-encoded query string into its decoded key/value pairs, like QUrl::queryItems() does.
+*/
+void Signer::addQueryParameters(ByteSpan query)
+{
+	const char* begin = query.data;
+	const char* end = query.data + query.size;
+
+	while (begin < end) {
+		const char* pairEnd = std::find(begin, end, '&');
+		if (pairEnd != begin) {
+			const char* equal = std::find(begin, pairEnd, '=');
+			percentDecode(ByteSpan(begin, equal - begin), m_decodedKey);
+			percentDecode(equal == pairEnd ? ByteSpan() : ByteSpan(equal + 1, pairEnd - equal - 1), m_decodedValue);
+			addParameter(m_decodedKey, m_decodedValue);
+		}
+		begin = pairEnd + 1;
+	}
+}
+}
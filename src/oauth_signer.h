@@ -0,0 +1,156 @@
+/*
+ *  SimpleOauth - A simple OAuth authentication library for Qt
+ *
+ *  Copyright (C) 2010 Gregory Schlomoff <gregory.schlomoff@gmail.com>
+ *                     http://gregschlom.com
+ *
+ *  Permission is hereby granted, free of charge, to any person obtaining a copy
+ *  of this software and associated documentation files (the "Software"), to deal
+ *  in the Software without restriction, including without limitation the rights
+ *  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ *  copies of the Software, and to permit persons to whom the Software is
+ *  furnished to do so, subject to the following conditions:
+ *
+ *  The above copyright notice and this permission notice shall be included in
+ *  all copies or substantial portions of the Software.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ *  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ *  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ *  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ *  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ *  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ *  THE SOFTWARE.
+ */
+
+#ifndef OAUTH_SIGNER_H
+#define OAUTH_SIGNER_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Same as simpleoauth_export.h, without requiring the Qt headers
+#ifndef SIMPLEOAUTH_SIGNER_EXPORT
+# if defined(SIMPLEOAUTH_STATIC_LIB)
+#  define SIMPLEOAUTH_SIGNER_EXPORT
+# elif defined(_WIN32)
+#  if defined(MAKE_SIMPLEOAUTH_LIB)
+#   define SIMPLEOAUTH_SIGNER_EXPORT __declspec(dllexport)
+#  else
+#   define SIMPLEOAUTH_SIGNER_EXPORT __declspec(dllimport)
+#  endif
+# elif defined(__GNUC__)
+#  define SIMPLEOAUTH_SIGNER_EXPORT __attribute__((visibility("default")))
+# else
+#  define SIMPLEOAUTH_SIGNER_EXPORT
+# endif
+#endif
+
+namespace OAuth {
+
+/*!
+  A non-owning view over raw bytes. The signer never copies its inputs, so the
+  underlying buffers must stay alive for the duration of the call.
+*/
+struct SIMPLEOAUTH_SIGNER_EXPORT ByteSpan
+{
+	ByteSpan() : data(0), size(0) {}
+	ByteSpan(const char* bytes, std::size_t length) : data(bytes), size(length) {}
+	ByteSpan(const char* string);
+	ByteSpan(const std::string& string) : data(string.data()), size(string.size()) {}
+
+	bool isEmpty() const { return size == 0; }
+
+	const char* data;
+	std::size_t size;
+};
+
+struct SIMPLEOAUTH_SIGNER_EXPORT SigningParameter
+{
+	ByteSpan key;   // not percent-encoded
+	ByteSpan value; // not percent-encoded
+};
+
+struct SIMPLEOAUTH_SIGNER_EXPORT SigningRequest
+{
+	enum TokenKind {
+		Temporary, // no token yet, sends oauth_callback
+		Request,   // sends oauth_token and oauth_verifier
+		Access     // sends oauth_token
+	};
+
+	SigningRequest();
+
+	TokenKind tokenKind;
+	ByteSpan method;         // "GET", "POST", ...
+	ByteSpan baseUrl;        // scheme://host[:port]/path, not percent-encoded, without the query
+	ByteSpan query;          // percent-encoded query string, without the leading '?'
+	const SigningParameter* parameters; // additional parameters, typically the POST body
+	std::size_t parameterCount;
+
+	ByteSpan consumerKey;
+	ByteSpan consumerSecret;
+	ByteSpan token;
+	ByteSpan tokenSecret;
+	ByteSpan verifier;
+	ByteSpan callbackUrl;
+
+	ByteSpan nonce;
+	ByteSpan timestamp;
+
+	ByteSpan saslUrl;        // if not empty, produces a SASL XOAUTH string instead of an HTTP header
+};
+
+/*!
+  Generates OAuth nonces from a private xorshift state.
+  Not thread-safe: give each thread its own generator.
+*/
+class SIMPLEOAUTH_SIGNER_EXPORT NonceGenerator
+{
+public:
+	explicit NonceGenerator(unsigned long long seed);
+
+	ByteSpan next(); // valid until the next call
+
+private:
+	unsigned long long m_state;
+	char m_buffer[24];
+};
+
+/*!
+  HMAC-SHA1 signing core, free of any Qt type.
+  A Signer holds no global state, only scratch buffers that are reused from one
+  call to the next: it is reentrant, and each thread should use its own instance.
+*/
+class SIMPLEOAUTH_SIGNER_EXPORT Signer
+{
+public:
+	Signer();
+
+	void sign(const SigningRequest& request, std::string& header);
+
+	static void percentEncode(ByteSpan input, std::string& output);
+	static void hmacSha1Base64(ByteSpan message, ByteSpan key, std::string& output);
+
+private:
+	struct Range {
+		std::size_t offset;
+		std::size_t size;
+	};
+
+	void addParameter(ByteSpan key, ByteSpan value);
+	void addQueryParameters(ByteSpan query);
+
+	std::string m_pairs;
+	std::vector<Range> m_ranges;
+	std::string m_decodedKey;
+	std::string m_decodedValue;
+	std::string m_baseString;
+	std::string m_key;
+	std::string m_scratch;
+	std::string m_signature;
+};
+}
+
+#endif // OAUTH_SIGNER_H
@@ -25,9 +25,13 @@
 
 #include "oauth_token_p.h"
 
-#include <QCryptographicHash>
+#include "oauth_recorder.h"
+#include "oauth_signer.h"
+
 #include <QDateTime>
-#include <QStringList>
+#include <QThread>
+#include <QThreadStorage>
+#include <QVector>
 #include <QDebug>
 
 namespace OAuth {
@@ -40,9 +44,10 @@ TokenPrivate::TokenPrivate()
 	  callbackUrl(),
 	  oauthToken(),
 	  oauthTokenSecret(),
-	  oauthVerifier()
+	  oauthVerifier(),
+	  refreshToken(),
+	  expirationDate()
 {
-	qsrand(QTime::currentTime().msec());
 }
 
 TokenPrivate::TokenPrivate(const TokenPrivate& other)
@@ -53,9 +58,10 @@ TokenPrivate::TokenPrivate(const TokenPrivate& other)
 	  callbackUrl(other.callbackUrl),
 	  oauthToken(other.oauthToken),
 	  oauthTokenSecret(other.oauthTokenSecret),
-	  oauthVerifier(other.oauthVerifier)
+	  oauthVerifier(other.oauthVerifier),
+	  refreshToken(other.refreshToken),
+	  expirationDate(other.expirationDate)
 {
-	qsrand(QTime::currentTime().msec());
 }
 
 Token::Token()
@@ -80,183 +86,154 @@ Token& Token::operator=(const Token& other)
 	return *this;
 }
 
-// Helper function to avoid writting "QString(QUrl::toPercentEncoding(xxx)" 10 times
-inline QString encode(QString string) { return QString(QUrl::toPercentEncoding(string)); }
-
-QByteArray Token::signRequest(const QUrl& requestUrl, Token::AuthMethod authMethod, Token::HttpMethod method, const QMultiMap<QString, QString>& parameters) const
+/*!
+  \internal
+  Per-thread signing state: the signer's scratch buffers and the nonce generator.
+  Keeping one per thread makes signRequest() reentrant without any locking.
+*/
+struct SigningContext
 {
-	QString timestamp;
-	QString nonce;
-
-	if (d->consumerKey == "test_token") { // Set known values for unit-testing
-		timestamp = "1234567890";	//Feb 13, 2009, 23:31:30 GMT
-		nonce = "ABCDEF";
-	} else {
-#if QT_VERSION >= 0x040700
-		timestamp = QString::number(QDateTime::currentDateTimeUtc().toTime_t());
-#else
-		timestamp = QString::number(QDateTime::currentDateTime().toUTC().toTime_t());
-#endif
-		nonce = QString::number(qrand());
+	SigningContext()
+		: signer(),
+		  nonces(seed() ^ (quintptr)QThread::currentThreadId() ^ (quintptr)this),
+		  header()
+	{
 	}
 
-	if (!requestUrl.isValid()) {
-		qWarning() << "OAuth::Token: Invalid url. The request will probably be invalid";
+	static quint64 seed()
+	{
+		return QDateTime::currentMSecsSinceEpoch();
 	}
 
-	// Step 1. Get all the oauth params for this request
-
-	QMultiMap<QString, QString> oauthParams;
-
-	oauthParams.insert("oauth_consumer_key", d->consumerKey);
-	oauthParams.insert("oauth_signature_method", "HMAC-SHA1");
-	oauthParams.insert("oauth_timestamp", timestamp);
-	oauthParams.insert("oauth_nonce", nonce);
-	oauthParams.insert("oauth_version", "1.0");
-
-	switch (d->tokenType) {
-	case Token::InvalidToken:
-		oauthParams.insert("oauth_callback", d->callbackUrl.toString());
-		break;
-
-	case Token::RequestToken:
-		oauthParams.insert("oauth_token", d->oauthToken);
-		oauthParams.insert("oauth_verifier", d->oauthVerifier);
-		break;
-
-	case Token::AccessToken:
-		oauthParams.insert("oauth_token", d->oauthToken);
-		break;
-	}
-
-	// Step 2. Take the parameters from the url, and add the oauth params to them
-
-	QMultiMap<QString, QString> allParams = oauthParams;
-	QList<QPair<QString, QString> > queryItems = requestUrl.queryItems();
-	for(int i = 0; i < queryItems.count(); ++i) {
-		allParams.insert(queryItems[i].first, queryItems[i].second);
-	}
-
-	allParams.unite(parameters);
-
-	// Step 3. Calculate the signature from those params, and append the signature to the oauth params
-
-	QString signature = generateSignature(requestUrl, allParams, method);
-	oauthParams.insert("oauth_signature", signature);
-
-	// Step 4. Concatenate all oauth params into one comma-separated string
-
-	QByteArray authHeader;
+	Signer signer;
+	NonceGenerator nonces;
+	std::string header;
+};
 
-	if (authMethod == Sasl) {
-		authHeader = "GET ";
-		authHeader.append(requestUrl.toString() + " ");
-	} else {
-		authHeader = "OAuth ";
-	}
+static QThreadStorage<SigningContext*> signingContexts;
 
-	QMultiMap<QString, QString>::const_iterator p = oauthParams.constBegin();
-	while (p != oauthParams.constEnd()) {
-		authHeader += QString("%1=\"%2\",").arg(p.key()).arg(encode(p.value()));
-		++p;
+static SigningContext* signingContext()
+{
+	if (!signingContexts.hasLocalData()) {
+		signingContexts.setLocalData(new SigningContext());
 	}
-	authHeader.chop(1); // remove the last character (the trailing ",")
-
-	return authHeader;
+	return signingContexts.localData();
 }
 
+// Helper function to view the bytes of a QByteArray without copying them
+inline ByteSpan span(const QByteArray& bytes) { return ByteSpan(bytes.constData(), bytes.size()); }
+
 /*!
-  \internal
-  Generates the OAuth signature.
-  \see http://oauth.net/core/1.0a/#signing_process
+  Signs the request and returns the value of the Authorization header.
+  This converts the Qt types and hands them to OAuth::Signer, which does the actual work.
 */
-QString Token::generateSignature(const QUrl& requestUrl, const QMultiMap<QString, QString>& requestParameters, HttpMethod method) const
+QByteArray Token::signRequest(const QUrl& requestUrl, Token::AuthMethod authMethod, Token::HttpMethod method, const QMultiMap<QString, QString>& parameters) const
 {
-	QString key = encode(d->consumerSecret) + "&" + encode(d->oauthTokenSecret);
-	QString baseString;
+	QByteArray timestamp;
+	QByteArray nonce;
 
-	switch (method) {
-	case HttpGet:    baseString = "GET&";    break;
-	case HttpPost:   baseString = "POST&";   break;
-	case HttpPut:    baseString = "PUT&";    break;
-	case HttpDelete: baseString = "DELETE&"; break;
-	case HttpHead:   baseString = "HEAD&";   break;
+	if (d->tokenType == Token::BearerToken) {
+		// Nothing to sign
+	} else if (d->consumerKey == "test_token") { // Set known values for unit-testing
+		timestamp = "1234567890";	//Feb 13, 2009, 23:31:30 GMT
+		nonce = "ABCDEF";
+	} else {
+		timestamp = QByteArray::number(QDateTime::currentDateTimeUtc().toTime_t());
+		ByteSpan generated = signingContext()->nonces.next();
+		nonce = QByteArray::fromRawData(generated.data, generated.size); // valid until the next nonce of this thread
 	}
 
-	baseString += encode(requestUrl.toString(QUrl::RemoveQuery)) + "&";
+	QByteArray authHeader = signRequest(requestUrl, authMethod, method, parameters, nonce, timestamp);
 
-	// encode and concatenate the parameters into a string
-	QStringList params;
-	QMap<QString, QString>::const_iterator p = requestParameters.constBegin();
-	while (p != requestParameters.constEnd()) {
-		params << QString("%1=%2").arg(encode(p.key())).arg(encode(p.value()));
-		++p;
+	if (SigningRecorder::isRecording()) {
+		SigningRecorder::record(*this, requestUrl, authMethod, method, parameters, nonce, timestamp);
 	}
-	qSort(params);
 
-	baseString += encode(params.join("&"));
-
-	// Ok, we have the normalized base string and the key, calculate the HMAC-SHA1 signature
-	return hmac_sha1(baseString, key);
+	return authHeader;
 }
 
 /*!
-  Calculates the HMAC-SHA1 signature from a message and a key.
-  This method comes from the kQOAuth library (http://www.d-pointer.com/solutions/kqoauth/)
-  Author: Johan Paul (johan.paul@d-pointer.com)
+  Signs the request with the given \a nonce and \a timestamp instead of fresh ones.
+  Useful to reproduce a signature, when replaying recorded requests for example.
 */
-QString Token::hmac_sha1(const QString& message, const QString& key) const
+QByteArray Token::signRequest(const QUrl& requestUrl, Token::AuthMethod authMethod, Token::HttpMethod method, const QMultiMap<QString, QString>& parameters,
+                              const QByteArray& nonce, const QByteArray& timestamp) const
 {
-	QByteArray keyBytes = key.toAscii();
-	int keyLength;              // Length of key word
-	const int blockSize = 64;   // Both MD5 and SHA-1 have a block size of 64.
-
-	keyLength = keyBytes.size();
-	// If key is longer than block size, we need to hash the key
-	if (keyLength > blockSize) {
-		QCryptographicHash hash(QCryptographicHash::Sha1);
-		hash.addData(keyBytes);
-		keyBytes = hash.result();
+	// OAuth 2.0 bearer tokens are sent as-is, there is nothing to sign
+	if (d->tokenType == Token::BearerToken) {
+		if (authMethod == Sasl) {
+			qWarning("OAuth::Token: Bearer tokens can only be sent in an HTTP header");
+			return QByteArray();
+		}
+		return "Bearer " + d->oauthToken.toAscii();
 	}
 
-	/* http://tools.ietf.org/html/rfc2104  - (1) */
-	// Create the opad and ipad for the hash function.
-	QByteArray ipad;
-	QByteArray opad;
-
-	ipad.fill( 0, blockSize);
-	opad.fill( 0, blockSize);
+	SigningContext* context = signingContext();
 
-	ipad.replace(0, keyBytes.length(), keyBytes);
-	opad.replace(0, keyBytes.length(), keyBytes);
+	SigningRequest request;
+	request.nonce = span(nonce);
+	request.timestamp = span(timestamp);
 
-	/* http://tools.ietf.org/html/rfc2104 - (2) & (5) */
-	for (int i=0; i<64; i++) {
-		ipad[i] = ipad[i] ^ 0x36;
-		opad[i] = opad[i] ^ 0x5c;
+	if (!requestUrl.isValid()) {
+		qWarning() << "OAuth::Token: Invalid url. The request will probably be invalid";
 	}
 
-	QByteArray workArray;
-	workArray.clear();
+	switch (method) {
+	case HttpGet:    request.method = "GET";    break;
+	case HttpPost:   request.method = "POST";   break;
+	case HttpPut:    request.method = "PUT";    break;
+	case HttpDelete: request.method = "DELETE"; break;
+	case HttpHead:   request.method = "HEAD";   break;
+	}
 
-	workArray.append(ipad, 64);
-	/* http://tools.ietf.org/html/rfc2104 - (3) */
-	workArray.append(message.toAscii());
+	QByteArray baseUrl = requestUrl.toString(QUrl::RemoveQuery).toUtf8();
+	QByteArray query = requestUrl.encodedQuery();
+	request.baseUrl = span(baseUrl);
+	request.query = span(query);
 
+	QByteArray saslUrl;
+	if (authMethod == Sasl) {
+		saslUrl = requestUrl.toString().toUtf8();
+		request.saslUrl = span(saslUrl);
+	}
 
-	/* http://tools.ietf.org/html/rfc2104 - (4) */
-	QByteArray sha1 = QCryptographicHash::hash(workArray, QCryptographicHash::Sha1);
+	QVector<QByteArray> parameterBytes;
+	QVector<SigningParameter> signingParameters(parameters.size());
+	parameterBytes.reserve(parameters.size() * 2);
+	QMultiMap<QString, QString>::const_iterator p = parameters.constBegin();
+	for (int i = 0; p != parameters.constEnd(); ++p, ++i) {
+		parameterBytes << p.key().toUtf8() << p.value().toUtf8();
+		signingParameters[i].key = span(parameterBytes[2 * i]);
+		signingParameters[i].value = span(parameterBytes[2 * i + 1]);
+	}
+	request.parameters = signingParameters.constData();
+	request.parameterCount = signingParameters.size();
+
+	QByteArray consumerKey = d->consumerKey.toUtf8();
+	QByteArray consumerSecret = d->consumerSecret.toUtf8();
+	QByteArray token = d->oauthToken.toUtf8();
+	QByteArray tokenSecret = d->oauthTokenSecret.toUtf8();
+	QByteArray verifier = d->oauthVerifier.toUtf8();
+	QByteArray callbackUrl = d->callbackUrl.toString().toUtf8();
+
+	request.consumerKey = span(consumerKey);
+	request.consumerSecret = span(consumerSecret);
+	request.token = span(token);
+	request.tokenSecret = span(tokenSecret);
+	request.verifier = span(verifier);
+	request.callbackUrl = span(callbackUrl);
 
-	/* http://tools.ietf.org/html/rfc2104 - (6) */
-	workArray.clear();
-	workArray.append(opad, 64);
-	workArray.append(sha1);
+	switch (d->tokenType) {
+	case Token::InvalidToken: request.tokenKind = SigningRequest::Temporary; break;
+	case Token::RequestToken: request.tokenKind = SigningRequest::Request;   break;
+	case Token::AccessToken:  request.tokenKind = SigningRequest::Access;    break;
+	case Token::BearerToken:  break; // Handled above
+	}
 
-	sha1.clear();
+	context->header.clear();
+	context->signer.sign(request, context->header);
 
-	/* http://tools.ietf.org/html/rfc2104 - (7) */
-	sha1 = QCryptographicHash::hash(workArray, QCryptographicHash::Sha1);
-	return QString(sha1.toBase64());
+	return QByteArray(context->header.data(), context->header.size());
 }
 
 // Setters
@@ -267,9 +244,17 @@ void Token::setTokenString   (const QString& token)             { d->oauthToken
 void Token::setTokenSecret   (const QString& tokenSecret)       { d->oauthTokenSecret = tokenSecret; }
 void Token::setVerifier      (const QString& verifier)          { d->oauthVerifier = QUrl::fromPercentEncoding(verifier.toAscii()); }
 void Token::setCallbackUrl   (const QUrl& callbackUrl)          { d->callbackUrl = callbackUrl; }
+void Token::setRefreshToken  (const QString& refreshToken)      { d->refreshToken = refreshToken; }
+void Token::setExpirationDate(const QDateTime& expirationDate)  { d->expirationDate = expirationDate; }
 
 // Getters
-Token::TokenType Token::type()        const { return d->tokenType; }
-QString          Token::tokenString() const { return d->oauthToken; }
-QString          Token::tokenSecret() const { return d->oauthTokenSecret; }
+Token::TokenType Token::type()           const { return d->tokenType; }
+QString          Token::consumerKey()    const { return d->consumerKey; }
+QString          Token::consumerSecret() const { return d->consumerSecret; }
+QString          Token::tokenString()    const { return d->oauthToken; }
+QString          Token::tokenSecret()    const { return d->oauthTokenSecret; }
+QString          Token::verifier()       const { return d->oauthVerifier; }
+QUrl             Token::callbackUrl()    const { return d->callbackUrl; }
+QString          Token::refreshToken()   const { return d->refreshToken; }
+QDateTime        Token::expirationDate() const { return d->expirationDate; }
 }
@@ -26,12 +26,14 @@
 #ifndef OAUTH_TOKEN_H
 #define OAUTH_TOKEN_H
 
+#include <QMetaType>
 #include <QSharedData>
 #include <QMultiMap>
 #include <QString>
 #include "simpleoauth_export.h"
 
 class QUrl;
+class QDateTime;
 
 namespace OAuth {
 
@@ -43,7 +45,8 @@ public:
 	enum TokenType {
 		InvalidToken,
 		RequestToken,
-		AccessToken
+		AccessToken,
+		BearerToken
 	};
 
 	enum AuthMethod {
@@ -71,23 +74,36 @@ public:
 	void setTokenString(const QString& token);
 	void setTokenSecret(const QString& tokenSecret);
 	void setVerifier(const QString& verifier);
+	void setRefreshToken(const QString& refreshToken);
+	void setExpirationDate(const QDateTime& expirationDate);
 
 	Token::TokenType type() const;
+	QString consumerKey() const;
+	QString consumerSecret() const;
 	QString tokenString() const;
 	QString tokenSecret() const;
+	QString verifier() const;
+	QUrl callbackUrl() const;
+	QString refreshToken() const;
+	QDateTime expirationDate() const;
 
 	QByteArray signRequest(const QUrl& requestUrl,
 	                       Token::AuthMethod authMethod = HttpHeader,
 	                       Token::HttpMethod method = HttpGet,
                                const QMultiMap<QString, QString>& parameters = (QMultiMap<QString, QString>())) const;
+	QByteArray signRequest(const QUrl& requestUrl,
+	                       Token::AuthMethod authMethod,
+	                       Token::HttpMethod method,
+	                       const QMultiMap<QString, QString>& parameters,
+	                       const QByteArray& nonce,
+	                       const QByteArray& timestamp) const;
 
 private:
-	QString generateSignature(const QUrl& requestUrl, const QMultiMap<QString, QString>& requestParameters, HttpMethod method) const;
-	QString hmac_sha1(const QString &message, const QString &key) const;
-
     friend class TokenPrivate;
 	QSharedDataPointer<TokenPrivate> d;
 };
 }
 
+Q_DECLARE_METATYPE(OAuth::Token)
+
 #endif // OAUTH_TOKEN_H
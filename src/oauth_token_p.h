@@ -28,6 +28,7 @@
 
 #include "oauth_token.h"
 
+#include <QDateTime>
 #include <QSharedData>
 #include <QUrl>
 
@@ -47,6 +48,8 @@ public:
 	QString oauthToken;
 	QString oauthTokenSecret;
 	QString oauthVerifier;
+	QString refreshToken;
+	QDateTime expirationDate;
 };
 
 }
@@ -13,15 +13,26 @@ CONFIG(static) {
 
 SOURCES += \
 	oauth_token.cpp \
-	oauth_helper.cpp
+	oauth_helper.cpp \
+	oauth_networkpool.cpp \
+	oauth_recorder.cpp \
+	oauth_refresher.cpp \
+	oauth_scheduler.cpp \
+	oauth_signer.cpp
 
 PRIVATE_HEADERS += \
+	oauth_shared_p.h \
 	oauth_token_p.h
 
 PUBLIC_HEADERS  += \
 	simpleoauth_export.h \
 	oauth_token.h \
-	oauth_helper.h
+	oauth_helper.h \
+	oauth_networkpool.h \
+	oauth_recorder.h \
+	oauth_refresher.h \
+	oauth_scheduler.h \
+	oauth_signer.h
 
 HEADERS += $$PRIVATE_HEADERS $$PUBLIC_HEADERS
 
@@ -0,0 +1,94 @@
+/*
+  This file is part of the Better Inbox project
+  Copyright (c) 2011 Better Inbox and/or Gregory Schlomoff.
+  All rights reserved.
+  contact@betterinbox.com
+*/
+
+#include "MockTokenEndpoint.h"
+
+#include <QHostAddress>
+#include <QTcpSocket>
+
+MockTokenEndpoint::MockTokenEndpoint(QObject *parent) :
+	QTcpServer(parent)
+{
+	m_defaultResponse.statusCode = 200;
+	connect(this, SIGNAL(newConnection()), SLOT(onNewConnection()));
+	listen(QHostAddress::LocalHost);
+}
+
+QUrl MockTokenEndpoint::url() const
+{
+	return QUrl(QString("http://127.0.0.1:%1/token").arg(serverPort()));
+}
+
+void MockTokenEndpoint::setResponse(int statusCode, const QByteArray& body)
+{
+	m_defaultResponse.statusCode = statusCode;
+	m_defaultResponse.body = body;
+}
+
+void MockTokenEndpoint::addResponse(int statusCode, const QByteArray& body, const QByteArray& headers)
+{
+	Response response;
+	response.statusCode = statusCode;
+	response.body = body;
+	response.headers = headers;
+	m_responses.append(response);
+}
+
+int MockTokenEndpoint::requestCount() const { return m_requestBodies.count(); }
+QByteArray MockTokenEndpoint::lastRequestBody() const { return m_requestBodies.isEmpty() ? QByteArray() : m_requestBodies.last(); }
+QList<QByteArray> MockTokenEndpoint::requestBodies() const { return m_requestBodies; }
+QByteArray MockTokenEndpoint::lastRequestHeaders() const { return m_lastRequestHeaders; }
+
+void MockTokenEndpoint::onNewConnection()
+{
+	while (hasPendingConnections()) {
+		QTcpSocket* socket = nextPendingConnection();
+		connect(socket, SIGNAL(readyRead()), SLOT(onReadyRead()));
+		connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+		m_buffers.insert(socket, QByteArray());
+	}
+}
+
+void MockTokenEndpoint::onReadyRead()
+{
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(sender());
+	QByteArray& buffer = m_buffers[socket];
+	buffer += socket->readAll();
+
+	// Wait for the headers, then for the whole body
+	int headerEnd = buffer.indexOf("\r\n\r\n");
+	if (headerEnd < 0) {
+		return;
+	}
+
+	int contentLength = 0;
+	foreach (const QByteArray& line, buffer.left(headerEnd).split('\n')) {
+		if (line.toLower().startsWith("content-length:")) {
+			contentLength = line.mid(15).trimmed().toInt();
+		}
+	}
+
+	if (buffer.size() < headerEnd + 4 + contentLength) {
+		return;
+	}
+
+	m_requestBodies.append(buffer.mid(headerEnd + 4, contentLength));
+	m_lastRequestHeaders = buffer.left(headerEnd + 2);
+	m_buffers.remove(socket);
+
+	Response canned = m_responses.isEmpty() ? m_defaultResponse : m_responses.takeFirst();
+
+	QByteArray response = "HTTP/1.1 " + QByteArray::number(canned.statusCode) + " Mock\r\n";
+	response += "Content-Type: application/json\r\n";
+	response += "Content-Length: " + QByteArray::number(canned.body.size()) + "\r\n";
+	response += canned.headers;
+	response += "Connection: close\r\n\r\n";
+	response += canned.body;
+
+	socket->write(response);
+	socket->disconnectFromHost();
+}
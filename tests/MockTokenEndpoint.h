@@ -0,0 +1,57 @@
+/*
+  This file is part of the Better Inbox project
+  Copyright (c) 2011 Better Inbox and/or Gregory Schlomoff.
+  All rights reserved.
+  contact@betterinbox.com
+*/
+
+#ifndef MOCKTOKENENDPOINT_H
+#define MOCKTOKENENDPOINT_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QTcpServer>
+#include <QUrl>
+
+class QTcpSocket;
+
+/*!
+  Local HTTP server answering the requests with canned responses: first the ones added with
+  addResponse(), in order, then the one set with setResponse().
+  Used to test the OAuth 2.0 grants of OAuth::Helper without a real provider.
+*/
+class MockTokenEndpoint : public QTcpServer
+{
+	Q_OBJECT
+public:
+	explicit MockTokenEndpoint(QObject *parent = 0);
+
+	QUrl url() const;
+	void setResponse(int statusCode, const QByteArray& body);
+	void addResponse(int statusCode, const QByteArray& body, const QByteArray& headers = QByteArray());
+
+	int requestCount() const;
+	QByteArray lastRequestBody() const;
+	QList<QByteArray> requestBodies() const;
+	QByteArray lastRequestHeaders() const;
+
+private slots:
+	void onNewConnection();
+	void onReadyRead();
+
+private:
+	struct Response {
+		int statusCode;
+		QByteArray body;
+		QByteArray headers;
+	};
+
+	QHash<QTcpSocket*, QByteArray> m_buffers;
+	Response m_defaultResponse;
+	QList<Response> m_responses;
+	QList<QByteArray> m_requestBodies;
+	QByteArray m_lastRequestHeaders;
+};
+
+#endif // MOCKTOKENENDPOINT_H
@@ -6,13 +6,26 @@
 */
 
 #include "Test.h"
+#include <QElapsedTimer>
+#include <QHostAddress>
 #include <QNetworkAccessManager>
+#include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QPointer>
 #include <QDebug>
+#include <QDir>
+#include <QTcpSocket>
 #include <QUrl>
 #include <QMultiMap>
 
+#include "oauth_helper.h"
+#include "oauth_networkpool.h"
+#include "oauth_recorder.h"
+#include "oauth_refresher.h"
+#include "oauth_signer.h"
 #include "oauth_token.h"
+#include "signing_proxy.h"
+#include "MockTokenEndpoint.h"
 
 typedef QMultiMap<QString, QString> StringMap;
 Q_DECLARE_METATYPE(StringMap)
@@ -21,6 +34,8 @@ Q_DECLARE_METATYPE(OAuth::Token::HttpMethod)
 Test::Test(QObject *parent) :
     QObject(parent)
 {
+	qRegisterMetaType<OAuth::Token>("OAuth::Token");
+	qRegisterMetaType<QNetworkReply*>("QNetworkReply*");
 }
 
 /*!
@@ -73,4 +88,605 @@ void Test::oauthSignature()
 
 }
 
+static OAuth::Token benchmarkToken()
+{
+	OAuth::Token token;
+	token.setType(OAuth::Token::AccessToken);
+	token.setConsumerKey("dpf43f3p2l4k3l03");
+	token.setConsumerSecret("kd94hf93k423kf44");
+	token.setTokenString("nnch734d00sl2jdk");
+	token.setTokenSecret("pfkkdhi9sl3r4s00");
+	return token;
+}
+
+/*!
+  Same expectations as oauthSignature, but calling OAuth::Signer directly with raw bytes
+*/
+void Test::signerCore()
+{
+	OAuth::SigningParameter parameters[2];
+	parameters[0].key = "param1";
+	parameters[0].value = "123";
+	parameters[1].key = "param2";
+	parameters[1].value = "345";
+
+	OAuth::SigningRequest request;
+	request.tokenKind = OAuth::SigningRequest::Access;
+	request.method = "POST";
+	request.baseUrl = "http://example.com/path";
+	request.parameters = parameters;
+	request.parameterCount = 2;
+	request.consumerKey = "test_token";
+	request.consumerSecret = "consumersecret";
+	request.token = "tokenstring";
+	request.tokenSecret = "tokensecret";
+	request.nonce = "ABCDEF";
+	request.timestamp = "1234567890";
+
+	OAuth::Signer signer;
+	std::string header;
+	signer.sign(request, header);
+	QVERIFY(QByteArray(header.c_str()).contains("oauth_signature=\"KgEjaHO%2Bs%2FNPQ7HMlVp7AdBYRUw%3D\""));
+
+	// The scratch buffers are reused from one call to the next
+	request.method = "GET";
+	request.query = "param=123&param=345";
+	request.parameterCount = 0;
+	header.clear();
+	signer.sign(request, header);
+	QVERIFY(QByteArray(header.c_str()).contains("oauth_signature=\"BuWBw8WGvgqWJXbskF6XIkVy5v4%3D\""));
+}
+
+void Test::signRequestBenchmark()
+{
+	OAuth::Token token = benchmarkToken();
+	QUrl url("http://photos.example.net/photos?file=vacation.jpg&size=original");
+	StringMap params;
+	params.insert("title", "Summer vacation");
+	params.insert("album", "2011");
+
+	QBENCHMARK {
+		token.signRequest(url, OAuth::Token::HttpHeader, OAuth::Token::HttpPost, params);
+	}
+}
+
+/*!
+  Same request as signRequestBenchmark, without the Qt conversions
+*/
+void Test::signerBenchmark()
+{
+	OAuth::SigningParameter parameters[2];
+	parameters[0].key = "title";
+	parameters[0].value = "Summer vacation";
+	parameters[1].key = "album";
+	parameters[1].value = "2011";
+
+	OAuth::SigningRequest request;
+	request.tokenKind = OAuth::SigningRequest::Access;
+	request.method = "POST";
+	request.baseUrl = "http://photos.example.net/photos";
+	request.query = "file=vacation.jpg&size=original";
+	request.parameters = parameters;
+	request.parameterCount = 2;
+	request.consumerKey = "dpf43f3p2l4k3l03";
+	request.consumerSecret = "kd94hf93k423kf44";
+	request.token = "nnch734d00sl2jdk";
+	request.tokenSecret = "pfkkdhi9sl3r4s00";
+	request.timestamp = "1191242096";
+
+	OAuth::Signer signer;
+	OAuth::NonceGenerator nonces(1);
+	std::string header;
+
+	QBENCHMARK {
+		request.nonce = nonces.next();
+		header.clear();
+		signer.sign(request, header);
+	}
+}
+
+void Test::bearerSignature()
+{
+	OAuth::Token token;
+	token.setType(OAuth::Token::BearerToken);
+	token.setTokenString("mF_9.B5f-4.1JqM");
+
+	QCOMPARE(token.signRequest(QUrl("https://example.com/resource?x=1"), OAuth::Token::HttpHeader, OAuth::Token::HttpPost),
+	         QByteArray("Bearer mF_9.B5f-4.1JqM"));
+
+	// Not a valid SASL string
+	QTest::ignoreMessage(QtWarningMsg, "OAuth::Token: Bearer tokens can only be sent in an HTTP header");
+	QVERIFY(token.signRequest(QUrl("https://example.com/resource"), OAuth::Token::Sasl).isEmpty());
+}
+
+void Test::clientCredentialsGrant()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"2YotnFZFEjr1zCsicMWpAA\",\"token_type\":\"Bearer\",\"expires_in\":3600}");
+
+	OAuth::Token clientToken;
+	clientToken.setConsumerKey("client id");
+	clientToken.setConsumerSecret("secret");
+
+	OAuth::Helper helper;
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	helper.getClientCredentialsToken(clientToken, endpoint.url(), "read");
+	QTestEventLoop::instance().enterLoop(5);
+
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::NoError);
+	QCOMPARE(endpoint.lastRequestBody(), QByteArray("grant_type=client_credentials&scope=read&client_id=client%20id&client_secret=secret"));
+
+	OAuth::Token token = spy.at(0).at(0).value<OAuth::Token>();
+	QCOMPARE(token.type(), OAuth::Token::BearerToken);
+	QCOMPARE(token.tokenString(), QString("2YotnFZFEjr1zCsicMWpAA"));
+	QVERIFY(token.expirationDate() > QDateTime::currentDateTime().addSecs(3500));
+}
+
+void Test::refreshTokenGrant()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"new\",\"token_type\":\"bearer\",\"refresh_token\":\"tGzv3JOkF0XG5Qx2TlKWIA\",\"scope\":[\"a\",\"b\"]}");
+
+	OAuth::Token bearerToken;
+	bearerToken.setType(OAuth::Token::BearerToken);
+	bearerToken.setConsumerKey("client");
+	bearerToken.setConsumerSecret("secret");
+	bearerToken.setTokenString("old");
+	bearerToken.setRefreshToken("refresh/1");
+
+	OAuth::Helper helper;
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	helper.refreshAccessToken(bearerToken, endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::NoError);
+	QCOMPARE(endpoint.lastRequestBody(), QByteArray("grant_type=refresh_token&refresh_token=refresh%2F1&client_id=client&client_secret=secret"));
+
+	OAuth::Token token = spy.at(0).at(0).value<OAuth::Token>();
+	QCOMPARE(token.tokenString(), QString("new"));
+	QCOMPARE(token.refreshToken(), QString("tGzv3JOkF0XG5Qx2TlKWIA"));
+	QVERIFY(!token.expirationDate().isValid());
+}
+
+void Test::refreshTokenGrantError()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(400, "{\"error\":\"invalid_grant\"}");
+
+	OAuth::Token bearerToken;
+	bearerToken.setType(OAuth::Token::BearerToken);
+	bearerToken.setTokenString("old");
+	bearerToken.setRefreshToken("expired");
+
+	OAuth::Helper helper;
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	helper.refreshAccessToken(bearerToken, endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::RequestUnauthorized);
+	QCOMPARE(spy.at(0).at(0).value<OAuth::Token>().tokenString(), QString("old"));
+}
+
+void Test::tokenRefresher()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"renewed\",\"token_type\":\"bearer\",\"expires_in\":3600}");
+
+	OAuth::Token bearerToken;
+	bearerToken.setType(OAuth::Token::BearerToken);
+	bearerToken.setTokenString("current");
+	bearerToken.setRefreshToken("refresh");
+	bearerToken.setExpirationDate(QDateTime::currentDateTime().addSecs(2));
+
+	OAuth::TokenRefresher refresher;
+	refresher.setRefreshMargin(1);
+	connect(&refresher, SIGNAL(tokenRefreshed(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	refresher.start(bearerToken, endpoint.url());
+
+	// The current token is served until the refresh completes
+	QCOMPARE(refresher.token().tokenString(), QString("current"));
+	QCOMPARE(endpoint.requestCount(), 0);
+
+	QTestEventLoop::instance().enterLoop(5);
+
+	QVERIFY(!QTestEventLoop::instance().timeout());
+	QCOMPARE(endpoint.requestCount(), 1);
+	QCOMPARE(refresher.token().tokenString(), QString("renewed"));
+	QCOMPARE(refresher.token().refreshToken(), QString("refresh"));
+}
+
+void Test::tokenRefresherShortLifetime()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"short\",\"token_type\":\"bearer\",\"expires_in\":2}");
+
+	OAuth::Token clientToken;
+	clientToken.setConsumerKey("client");
+	clientToken.setConsumerSecret("secret");
+
+	// The default 60 seconds margin is longer than the token lifetime
+	OAuth::TokenRefresher refresher;
+	connect(&refresher, SIGNAL(tokenRefreshed(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	refresher.start(clientToken, endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+	QCOMPARE(endpoint.requestCount(), 1);
+
+	// The next refresh happens half-way through the lifetime, not right away
+	QTest::qWait(500);
+	QCOMPARE(endpoint.requestCount(), 1);
+
+	QTestEventLoop::instance().enterLoop(5);
+	QVERIFY(!QTestEventLoop::instance().timeout());
+	QCOMPARE(endpoint.requestCount(), 2);
+	QCOMPARE(refresher.token().tokenString(), QString("short"));
+}
+
+void Test::sharedNetworkPool()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	OAuth::Helper first;
+	OAuth::Helper second;
+	QVERIFY(first.networkPool() == second.networkPool());
+
+	first.networkPool()->setMaxConnectionsPerHost(endpoint.url(), 1);
+	QCOMPARE(second.networkPool()->maxConnectionsPerHost(endpoint.url()), 1);
+
+	// Each Helper only gets the replies to its own requests
+	QSignalSpy firstSpy(&first, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	QSignalSpy secondSpy(&second, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	first.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	second.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+
+	for (int i = 0; i < 50 && (firstSpy.count() == 0 || secondSpy.count() == 0); ++i) {
+		QTest::qWait(100);
+	}
+
+	QCOMPARE(firstSpy.count(), 1);
+	QCOMPARE(secondSpy.count(), 1);
+	QCOMPARE(endpoint.requestCount(), 2);
+}
+
+void Test::ownNetworkManager()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	QNetworkAccessManager networkManager;
+	OAuth::Helper helper;
+	helper.setOwnNetworkManager(&networkManager);
+	QVERIFY(helper.networkPool() != OAuth::NetworkPool::sharedPool());
+	QCOMPARE(helper.networkPool()->networkManager(), &networkManager);
+
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::NoError);
+}
+
+void Test::networkPoolDestroyedSender()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{}");
+
+	OAuth::NetworkPool pool;
+	pool.setMaxConnectionsPerHost(endpoint.url(), 1);
+
+	QObject* sender = new QObject();
+	QNetworkRequest request(endpoint.url());
+	request.setOriginatingObject(sender);
+	pool.get(request); // in flight
+	pool.get(request); // queued behind it
+
+	QList<QNetworkReply*> replies = pool.networkManager()->findChildren<QNetworkReply*>();
+	QCOMPARE(replies.count(), 1);
+	QPointer<QNetworkReply> orphan = replies.first();
+	delete sender;
+
+	// Requests without originating object are always sent
+	QSignalSpy spy(&pool, SIGNAL(finished(QNetworkReply*)));
+	pool.get(QNetworkRequest(endpoint.url()));
+
+	for (int i = 0; i < 50 && spy.count() == 0; ++i) {
+		QTest::qWait(100);
+	}
+	QTest::qWait(100);
+
+	// The queued request of the destroyed sender was dropped, and its reply deleted
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(endpoint.requestCount(), 2);
+	QVERIFY(orphan.isNull());
+}
+
+void Test::schedulerPriorities()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	OAuth::Helper helper;
+	helper.scheduler()->setMaxInFlight(1);
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url(), "background1", OAuth::RequestScheduler::Background);
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url(), "background2", OAuth::RequestScheduler::Background);
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url(), "interactive", OAuth::RequestScheduler::Interactive);
+
+	QCOMPARE(helper.scheduler()->inFlight(), 1);
+	QCOMPARE(helper.scheduler()->queueDepth(), 2);
+	QCOMPARE(helper.scheduler()->queueDepth(OAuth::RequestScheduler::Interactive), 1);
+
+	for (int i = 0; i < 50 && spy.count() < 3; ++i) {
+		QTest::qWait(100);
+	}
+
+	QCOMPARE(spy.count(), 3);
+	QCOMPARE(helper.scheduler()->queueDepth(), 0);
+
+	// The interactive request overtook the queued background one
+	QList<QByteArray> bodies = endpoint.requestBodies();
+	QVERIFY(bodies.at(0).contains("scope=background1"));
+	QVERIFY(bodies.at(1).contains("scope=interactive"));
+	QVERIFY(bodies.at(2).contains("scope=background2"));
+}
+
+void Test::schedulerRateLimit()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	OAuth::Helper helper;
+	helper.scheduler()->setRateLimit(endpoint.url(), 5, 1);
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < 3; ++i) {
+		helper.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	}
+	QCOMPARE(helper.scheduler()->queueDepth(), 2);
+
+	for (int i = 0; i < 50 && spy.count() < 3; ++i) {
+		QTest::qWait(50);
+	}
+
+	QCOMPARE(spy.count(), 3);
+	QVERIFY(timer.elapsed() >= 390); // 5 requests per second, without bursts
+	QVERIFY(helper.scheduler()->averageWaitTime() > 0);
+}
+
+void Test::schedulerBackoff()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.addResponse(429, "{\"error\":\"slow_down\"}", "Retry-After: 1\r\n");
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	OAuth::Helper helper;
+	helper.scheduler()->setRateLimit(endpoint.url(), 10, 1);
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+
+	QElapsedTimer timer;
+	timer.start();
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+
+	// The rate-limited request was retried after the delay asked by the server
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::NoError);
+	QCOMPARE(endpoint.requestCount(), 2);
+	QVERIFY(timer.elapsed() >= 1000);
+	QVERIFY(helper.scheduler()->rateLimit(endpoint.url()) < 10);
+}
+
+void Test::schedulerSharedHostLimit()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"access_token\":\"abc\",\"token_type\":\"bearer\"}");
+
+	OAuth::Helper first;
+	OAuth::Helper second;
+	QVERIFY(first.scheduler() == second.scheduler());
+	first.scheduler()->setRateLimit(endpoint.url(), 5, 1);
+	QSignalSpy firstSpy(&first, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	QSignalSpy secondSpy(&second, SIGNAL(bearerTokenReceived(OAuth::Token)));
+
+	// The limit set through one Helper holds back the requests of the other one
+	QElapsedTimer timer;
+	timer.start();
+	first.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	second.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	QCOMPARE(second.scheduler()->queueDepth(), 1);
+
+	for (int i = 0; i < 50 && (firstSpy.count() == 0 || secondSpy.count() == 0); ++i) {
+		QTest::qWait(50);
+	}
+
+	QCOMPARE(firstSpy.count(), 1);
+	QCOMPARE(secondSpy.count(), 1);
+	QVERIFY(timer.elapsed() >= 190);
+}
+
+void Test::schedulerRetriesExhausted_data()
+{
+	QTest::addColumn<int>("status");
+	QTest::addColumn<QByteArray>("headers");
+
+	QTest::newRow("429") << 429 << QByteArray();
+	QTest::newRow("503 with Retry-After") << 503 << QByteArray("Retry-After: 1\r\n");
+}
+
+void Test::schedulerRetriesExhausted()
+{
+	QFETCH(int, status);
+	QFETCH(QByteArray, headers);
+
+	MockTokenEndpoint endpoint;
+	endpoint.addResponse(status, "{\"error\":\"slow_down\"}", headers);
+
+	OAuth::Helper helper;
+	helper.scheduler()->setMaxRetries(0);
+	QSignalSpy spy(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)));
+	connect(&helper, SIGNAL(bearerTokenReceived(OAuth::Token)), &QTestEventLoop::instance(), SLOT(exitLoop()));
+	helper.getClientCredentialsToken(OAuth::Token(), endpoint.url());
+	QTestEventLoop::instance().enterLoop(5);
+
+	QCOMPARE(spy.count(), 1);
+	QCOMPARE(helper.lastError(), OAuth::Helper::RateLimited);
+	QCOMPARE(endpoint.requestCount(), 1);
+}
+
+/*!
+  Sends \a request to the proxy listening on \a port, and returns the response.
+  The event loop keeps running while waiting, since the proxy and the upstream live in this thread.
+*/
+static QByteArray proxyRequest(quint16 port, const QByteArray& request)
+{
+	QTcpSocket socket;
+	socket.connectToHost(QHostAddress::LocalHost, port);
+	socket.write(request);
+
+	QByteArray response;
+	for (int i = 0; i < 50; ++i) {
+		QTest::qWait(50);
+		response += socket.readAll();
+
+		int headerEnd = response.indexOf("\r\n\r\n");
+		int lengthStart = response.indexOf("Content-Length: ");
+		if (headerEnd >= 0 && lengthStart >= 0 && lengthStart < headerEnd) {
+			int contentLength = response.mid(lengthStart + 16, response.indexOf("\r\n", lengthStart) - lengthStart - 16).toInt();
+			if (response.size() >= headerEnd + 4 + contentLength) {
+				break;
+			}
+		}
+	}
+	return response;
+}
+
+void Test::signingProxy()
+{
+	MockTokenEndpoint endpoint;
+	endpoint.setResponse(200, "{\"ok\":true}");
+
+	OAuth::Token token;
+	token.setType(OAuth::Token::AccessToken);
+	token.setConsumerKey("dpf43f3p2l4k3l03");
+	token.setConsumerSecret("kd94hf93k423kf44");
+	token.setTokenString("nnch734d00sl2jdk");
+	token.setTokenSecret("pfkkdhi9sl3r4s00");
+
+	OAuth::SigningProxy proxy;
+	proxy.setStatsInterval(0);
+	QVERIFY(!proxy.addTenant("insecure", token, QList<QUrl>() << QUrl("http://api.example.com")));
+	QVERIFY(proxy.addTenant("my-app", token, QList<QUrl>() << endpoint.url()));
+	QVERIFY(proxy.listen(QHostAddress::LocalHost));
+
+	QByteArray target = endpoint.url().toEncoded();
+	QByteArray response = proxyRequest(proxy.serverPort(),
+		"GET " + target + "?format=json HTTP/1.1\r\n"
+		"Host: 127.0.0.1\r\n"
+		"X-OAuth-Tenant: my-app\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 200"));
+	QVERIFY(response.endsWith("{\"ok\":true}"));
+	QVERIFY(endpoint.lastRequestHeaders().startsWith("GET /token?format=json HTTP/1.1\r\n"));
+	QVERIFY(endpoint.lastRequestHeaders().contains("Authorization: OAuth "));
+	QVERIFY(endpoint.lastRequestHeaders().contains("oauth_consumer_key=\"dpf43f3p2l4k3l03\""));
+	QVERIFY(endpoint.lastRequestHeaders().contains("oauth_token=\"nnch734d00sl2jdk\""));
+	QVERIFY(!endpoint.lastRequestHeaders().contains("X-OAuth-Tenant"));
+
+	response = proxyRequest(proxy.serverPort(),
+		"POST " + target + " HTTP/1.1\r\n"
+		"X-OAuth-Tenant: my-app\r\n"
+		"Content-Type: application/x-www-form-urlencoded\r\n"
+		"Content-Length: 18\r\n\r\n"
+		"status=hello+world");
+	QVERIFY(response.startsWith("HTTP/1.1 200"));
+	QCOMPARE(endpoint.lastRequestBody(), QByteArray("status=hello+world"));
+	QVERIFY(endpoint.lastRequestHeaders().startsWith("POST /token HTTP/1.1\r\n"));
+	QVERIFY(endpoint.lastRequestHeaders().contains("oauth_signature=\""));
+	QCOMPARE(endpoint.requestCount(), 2);
+
+	// Unknown tenants and targets outside the tenant's upstreams are refused
+	response = proxyRequest(proxy.serverPort(), "GET " + target + " HTTP/1.1\r\nX-OAuth-Tenant: other-app\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 403"));
+	response = proxyRequest(proxy.serverPort(), "GET http://example.com/token HTTP/1.1\r\nX-OAuth-Tenant: my-app\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 403"));
+	response = proxyRequest(proxy.serverPort(), "GET " + target + "/../admin HTTP/1.1\r\nX-OAuth-Tenant: my-app\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 403"));
+	response = proxyRequest(proxy.serverPort(), "GET " + target + "/%2e%2e/admin HTTP/1.1\r\nX-OAuth-Tenant: my-app\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 403"));
+	response = proxyRequest(proxy.serverPort(), "POST " + target + " HTTP/1.1\r\nX-OAuth-Tenant: my-app\r\nContent-Length: -1\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 400"));
+	QCOMPARE(endpoint.requestCount(), 2);
+
+	response = proxyRequest(proxy.serverPort(), "GET /stats HTTP/1.1\r\n\r\n");
+	QVERIFY(response.startsWith("HTTP/1.1 200"));
+	QVERIFY(response.contains("{\"requests\":2,"));
+	QCOMPARE(proxy.requestCount(), quint64(2));
+}
+
+void Test::recordAndReplay()
+{
+	QString traceFile = QDir::temp().filePath("simpleoauth_test_trace.bin");
+
+	OAuth::Token token = benchmarkToken();
+	StringMap params;
+	params.insert("title", "Summer vacation");
+
+	QVERIFY(OAuth::SigningRecorder::start(traceFile));
+	QVERIFY(OAuth::SigningRecorder::isRecording());
+	token.signRequest(QUrl("http://photos.example.net/photos?file=vacation.jpg"));
+	token.signRequest(QUrl("http://photos.example.net/photos"), OAuth::Token::HttpHeader, OAuth::Token::HttpPost, params);
+	token.signRequest(QUrl("http://photos.example.net/albums"), OAuth::Token::Sasl, OAuth::Token::HttpGet);
+	OAuth::SigningRecorder::stop();
+	QVERIFY(!OAuth::SigningRecorder::isRecording());
+
+	// Not recorded anymore
+	token.signRequest(QUrl("http://photos.example.net/ignored"));
+
+	OAuth::SigningTraceReader reader;
+	QVERIFY(reader.open(traceFile));
+
+	QList<OAuth::RecordedRequest> requests;
+	OAuth::RecordedRequest request;
+	while (reader.readNext(request)) {
+		requests << request;
+	}
+	QVERIFY(reader.atEnd());
+	QCOMPARE(requests.count(), 3);
+
+	QCOMPARE(requests[1].url, QUrl("http://photos.example.net/photos"));
+	QCOMPARE(requests[1].method, OAuth::Token::HttpPost);
+	QCOMPARE(requests[1].parameters, params);
+	QCOMPARE(requests[2].authMethod, OAuth::Token::Sasl);
+
+	foreach (const OAuth::RecordedRequest& r, requests) {
+		// Secrets are redacted, with stable placeholders of the same length
+		QCOMPARE(r.token.consumerKey(), token.consumerKey());
+		QCOMPARE(r.token.tokenString(), token.tokenString());
+		QCOMPARE(r.token.consumerSecret().size(), token.consumerSecret().size());
+		QCOMPARE(r.token.tokenSecret().size(), token.tokenSecret().size());
+		QVERIFY(r.token.consumerSecret() != token.consumerSecret());
+		QVERIFY(r.token.tokenSecret() != token.tokenSecret());
+		QCOMPARE(r.token.consumerSecret(), requests[0].token.consumerSecret());
+
+		// Replaying gives the recorded signature
+		QByteArray authHeader = r.token.signRequest(r.url, r.authMethod, r.method, r.parameters, r.nonce, r.timestamp);
+		QVERIFY(authHeader.contains("oauth_nonce=\"" + r.nonce + "\""));
+		QVERIFY(!r.signature.isEmpty());
+		QCOMPARE(OAuth::SigningTraceReader::signature(authHeader), r.signature);
+	}
+
+	QFile::remove(traceFile);
+}
+
 QTEST_MAIN(Test)
\ No newline at end of file
@@ -20,6 +20,26 @@ public:
 private slots:
 	void oauthSignature_data();
 	void oauthSignature();
+	void signerCore();
+	void signRequestBenchmark();
+	void signerBenchmark();
+	void bearerSignature();
+	void clientCredentialsGrant();
+	void refreshTokenGrant();
+	void refreshTokenGrantError();
+	void tokenRefresher();
+	void tokenRefresherShortLifetime();
+	void sharedNetworkPool();
+	void ownNetworkManager();
+	void networkPoolDestroyedSender();
+	void schedulerPriorities();
+	void schedulerRateLimit();
+	void schedulerBackoff();
+	void schedulerSharedHostLimit();
+	void schedulerRetriesExhausted_data();
+	void schedulerRetriesExhausted();
+	void signingProxy();
+	void recordAndReplay();
 };
 
 #endif // TEST_H
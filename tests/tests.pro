@@ -6,11 +6,13 @@ CONFIG   -= app_bundle
 TEMPLATE = app
 
 SOURCES += \
-    Test.cpp
+    Test.cpp \
+    MockTokenEndpoint.cpp \
+    ../proxy/signing_proxy.cpp
 
 DEFINES += SIMPLEOAUTH_STATIC_LIB
 
-INCLUDEPATH += ../src
+INCLUDEPATH += ../src ../proxy
 
 LIBS += -L../lib/ -lsimpleoauth
 win32 {
@@ -21,4 +23,6 @@ win32 {
 
 
 HEADERS += \
-    Test.h
+    Test.h \
+    MockTokenEndpoint.h \
+    ../proxy/signing_proxy.h